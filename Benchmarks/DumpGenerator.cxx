@@ -0,0 +1,228 @@
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include <linux/if_link.h>
+#include <linux/if_bridge.h>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "DumpGenerator.hxx"
+
+// Sizes of the per-family configuration blobs of IFLA_AF_SPEC
+static constexpr size_t inetConfSize = 4 * 32;
+static constexpr size_t inet6ConfSize = 4 * 60;
+
+DumpGenerator::DumpGenerator (uint32_t portId, uint32_t seq,
+                              size_t datagramSize) :
+    _portId(portId), _seq(seq), _datagramSize(datagramSize)
+{}
+
+std::vector<std::vector<uint8_t>> DumpGenerator::generate (const Shape &shape)
+{
+    _datagrams.clear();
+    _current.clear();
+
+    std::vector<int> bridges;
+    for (size_t i = 1; i < shape.links; ++i)
+        if (shape.bridgeEvery && i % shape.bridgeEvery == 0)
+            bridges.push_back(i + 1);
+
+    // Spread the ports over the bridges evenly
+    double enslaved = 0;
+    size_t nextBridge = 0;
+    for (size_t i = 0; i < shape.links; ++i) {
+        const int index = i + 1;
+        const bool bridge = i && shape.bridgeEvery &&
+                            i % shape.bridgeEvery == 0;
+        uint32_t master = 0;
+
+        enslaved += shape.portShare;
+        if (i && ! bridge && ! bridges.empty() && enslaved >= 1) {
+            master = bridges[nextBridge++ % bridges.size()];
+            enslaved -= 1;
+        }
+
+        const size_t start = _current.size();
+        addLink(index, bridge, master);
+        seal(start);
+    }
+
+    // NLMSG_DONE carries the dump status
+    const size_t start = _current.size();
+    _current.resize(start + NLMSG_SPACE(sizeof(int)));
+    nlmsghdr *hdr = reinterpret_cast<nlmsghdr *>(_current.data() + start);
+    *hdr = {.nlmsg_len = static_cast<uint32_t>(NLMSG_LENGTH(sizeof(int))),
+            .nlmsg_type = NLMSG_DONE, .nlmsg_flags = NLM_F_MULTI,
+            .nlmsg_seq = _seq, .nlmsg_pid = _portId};
+    seal(start);
+
+    _datagrams.push_back(std::move(_current));
+    _current.clear();
+    return std::move(_datagrams);
+}
+
+void DumpGenerator::addLink (int index, bool bridge, uint32_t master)
+{
+    const size_t start = _current.size();
+    _current.resize(start + NLMSG_SPACE(sizeof(ifinfomsg)));
+
+    nlmsghdr *hdr = reinterpret_cast<nlmsghdr *>(_current.data() + start);
+    *hdr = {.nlmsg_len = static_cast<uint32_t>(NLMSG_LENGTH(sizeof(ifinfomsg))),
+            .nlmsg_type = RTM_NEWLINK, .nlmsg_flags = NLM_F_MULTI,
+            .nlmsg_seq = _seq, .nlmsg_pid = _portId};
+    ifinfomsg *ifi = reinterpret_cast<ifinfomsg *>(NLMSG_DATA(hdr));
+    const unsigned flags = index == 1 ? IFF_LOOPBACK
+                                      : IFF_BROADCAST | IFF_MULTICAST;
+    *ifi = {.ifi_family = AF_UNSPEC,
+            .ifi_type = static_cast<unsigned short>(index == 1 ? ARPHRD_LOOPBACK
+                                                               : ARPHRD_ETHER),
+            .ifi_index = index,
+            .ifi_flags = IFF_UP | IFF_RUNNING | IFF_LOWER_UP | flags,
+            .ifi_change = 0};
+
+    const std::string name =
+        index == 1 ? "lo" : std::format("{}{}", bridge ? "br" : "veth", index);
+    const uint8_t address [6] = {0x02, 0, 0,
+                                 static_cast<uint8_t>(index >> 16),
+                                 static_cast<uint8_t>(index >> 8),
+                                 static_cast<uint8_t>(index)};
+    const uint8_t broadcast [6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+    put(IFLA_IFNAME, name.c_str(), name.size() + 1);
+    put<uint32_t>(IFLA_TXQLEN, 1000);
+    put<uint8_t>(IFLA_OPERSTATE, IF_OPER_UP);
+    put<uint8_t>(IFLA_LINKMODE, 0);
+    put<uint32_t>(IFLA_MTU, 1500);
+    put<uint32_t>(IFLA_MIN_MTU, 68);
+    put<uint32_t>(IFLA_MAX_MTU, 65535);
+    put<uint32_t>(IFLA_GROUP, 0);
+    put<uint32_t>(IFLA_PROMISCUITY, master ? 1 : 0);
+    put<uint32_t>(IFLA_NUM_TX_QUEUES, 1);
+    put<uint32_t>(IFLA_GSO_MAX_SEGS, 65535);
+    put<uint32_t>(IFLA_GSO_MAX_SIZE, 65536);
+    put<uint32_t>(IFLA_NUM_RX_QUEUES, 1);
+    put<uint8_t>(IFLA_CARRIER, 1);
+    put(IFLA_QDISC, "noqueue", 8);
+    put<uint32_t>(IFLA_CARRIER_CHANGES, 2);
+    put<uint8_t>(IFLA_PROTO_DOWN, 0);
+    put(IFLA_ADDRESS, address, sizeof(address));
+    put(IFLA_BROADCAST, broadcast, sizeof(broadcast));
+    if (master)
+        put<uint32_t>(IFLA_MASTER, master);
+
+    if (index != 1) {
+        size_t linkInfo = begin(IFLA_LINKINFO);
+        if (bridge) {
+            put(IFLA_INFO_KIND, "bridge", 7);
+            addBridgeData();
+        } else {
+            put(IFLA_INFO_KIND, "veth", 5);
+            if (master) {
+                put(IFLA_INFO_SLAVE_KIND, "bridge", 7);
+                size_t slaveData = begin(IFLA_INFO_SLAVE_DATA);
+                put<uint8_t>(IFLA_BRPORT_STATE, BR_STATE_FORWARDING);
+                put<uint16_t>(IFLA_BRPORT_PRIORITY, 32);
+                put<uint32_t>(IFLA_BRPORT_COST, 2);
+                put<uint8_t>(IFLA_BRPORT_LEARNING, 1);
+                put<uint8_t>(IFLA_BRPORT_UNICAST_FLOOD, 1);
+                end(slaveData);
+            }
+        }
+        end(linkInfo);
+    }
+
+    addAfSpec();
+}
+
+void DumpGenerator::addBridgeData ()
+{
+    const uint8_t bridgeId [8] = {0x80, 0x00, 0x02, 0, 0, 0, 0, 0x01};
+
+    size_t data = begin(IFLA_INFO_DATA);
+    put<uint32_t>(IFLA_BR_FORWARD_DELAY, 1500);
+    put<uint32_t>(IFLA_BR_HELLO_TIME, 200);
+    put<uint32_t>(IFLA_BR_MAX_AGE, 2000);
+    put<uint32_t>(IFLA_BR_AGEING_TIME, 30000);
+    put<uint32_t>(IFLA_BR_STP_STATE, 0);
+    put<uint16_t>(IFLA_BR_PRIORITY, 32768);
+    put<uint8_t>(IFLA_BR_VLAN_FILTERING, 0);
+    put<uint16_t>(IFLA_BR_GROUP_FWD_MASK, 0);
+    put(IFLA_BR_BRIDGE_ID, bridgeId, sizeof(bridgeId));
+    put(IFLA_BR_ROOT_ID, bridgeId, sizeof(bridgeId));
+    put<uint16_t>(IFLA_BR_ROOT_PORT, 0);
+    put<uint32_t>(IFLA_BR_ROOT_PATH_COST, 0);
+    put<uint8_t>(IFLA_BR_TOPOLOGY_CHANGE, 0);
+    put<uint8_t>(IFLA_BR_TOPOLOGY_CHANGE_DETECTED, 0);
+    put<uint64_t>(IFLA_BR_HELLO_TIMER, 0);
+    put<uint64_t>(IFLA_BR_TCN_TIMER, 0);
+    put<uint64_t>(IFLA_BR_TOPOLOGY_CHANGE_TIMER, 0);
+    put<uint64_t>(IFLA_BR_GC_TIMER, 1234);
+    put<uint8_t>(IFLA_BR_MCAST_SNOOPING, 1);
+    put<uint32_t>(IFLA_BR_MCAST_HASH_MAX, 4096);
+    end(data);
+}
+
+void DumpGenerator::addAfSpec ()
+{
+    // The device configuration is opaque to the parser but takes most of
+    // the message in real dumps
+    const uint8_t inetConf [inetConfSize] = {};
+    const uint8_t inet6Conf [inet6ConfSize] = {};
+
+    size_t afSpec = begin(IFLA_AF_SPEC);
+    size_t inet = begin(AF_INET);
+    put(IFLA_INET_CONF, inetConf, sizeof(inetConf));
+    end(inet);
+    size_t inet6 = begin(AF_INET6);
+    put<uint32_t>(IFLA_INET6_FLAGS, 0x80000000);
+    put(IFLA_INET6_CONF, inet6Conf, sizeof(inet6Conf));
+    put<uint8_t>(IFLA_INET6_ADDR_GEN_MODE, 0);
+    end(inet6);
+    end(afSpec);
+}
+
+rtattr * DumpGenerator::put (uint16_t type, const void *data, size_t size)
+{
+    const size_t offset = _current.size();
+    _current.resize(offset + RTA_SPACE(size));
+
+    rtattr *attr = reinterpret_cast<rtattr *>(_current.data() + offset);
+    attr->rta_type = type;
+    attr->rta_len = RTA_LENGTH(size);
+    if (size)
+        std::memcpy(RTA_DATA(attr), data, size);
+    return attr;
+}
+
+size_t DumpGenerator::begin (uint16_t type)
+{
+    const size_t offset = _current.size();
+    put(type | NLA_F_NESTED, nullptr, 0);
+    return offset;
+}
+
+void DumpGenerator::end (size_t nest)
+{
+    rtattr *attr = reinterpret_cast<rtattr *>(_current.data() + nest);
+    attr->rta_len = _current.size() - nest;
+}
+
+void DumpGenerator::seal (size_t messageStart)
+{
+    nlmsghdr *hdr = reinterpret_cast<nlmsghdr *>(_current.data() +
+                                                 messageStart);
+    hdr->nlmsg_len = _current.size() - messageStart;
+
+    if (_current.size() <= _datagramSize)
+        return;
+    if (messageStart == 0)
+        throw std::runtime_error(
+            std::format("Message of {} bytes won't fit into a datagram",
+                        hdr->nlmsg_len));
+
+    std::vector<uint8_t> next (_current.begin() + messageStart,
+                               _current.end());
+    _current.resize(messageStart);
+    _datagrams.push_back(std::move(_current));
+    _current = std::move(next);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <cinttypes>
+#include <vector>
+#include <span>
+
+/* Builds in memory what the kernel sends in reply to an RTM_GETLINK dump:
+ * datagrams of RTM_NEWLINK messages closed by NLMSG_DONE. The messages carry
+ * roughly the attributes and the size of the real ones, so the parse path
+ * does the same work as with a live socket */
+
+class DumpGenerator
+{
+public:
+    struct Shape {
+        // Links in the dump, loopback included
+        size_t links = 1000;
+        // Every n-th link is a bridge
+        size_t bridgeEvery = 20;
+        // Part of the other links enslaved to the bridges
+        double portShare = 0.5;
+    };
+
+public:
+    // The replies are addressed as if the request came from portId with seq
+    DumpGenerator (uint32_t portId, uint32_t seq, size_t datagramSize);
+
+    // Take the whole dump split into datagrams
+    std::vector<std::vector<uint8_t>> generate (const Shape &shape);
+
+private:
+    void addLink (int index, bool bridge, uint32_t master);
+    void addBridgeData ();
+    void addAfSpec ();
+
+    rtattr * put (uint16_t type, const void *data, size_t size);
+    template <class T>
+    rtattr * put (uint16_t type, const T &value) {
+        return put(type, &value, sizeof(value));
+    }
+    // Nests are referred by offset as the buffer moves while growing
+    size_t begin (uint16_t type);
+    void end (size_t nest);
+
+    // Move the last message to a new datagram if it doesn't fit the current
+    void seal (size_t messageStart);
+
+private:
+    uint32_t _portId;
+    uint32_t _seq;
+    size_t _datagramSize;
+
+    std::vector<std::vector<uint8_t>> _datagrams;
+    std::vector<uint8_t> _current;
+};
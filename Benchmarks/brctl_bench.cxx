@@ -0,0 +1,277 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "Netlink.hxx"
+#include "Stats.hxx"
+#include "DumpGenerator.hxx"
+
+/* Microbenchmarks of the dump parse path and of 'show' formatting.
+ * The dumps are synthetic so neither privileges nor interfaces are needed */
+
+/* Serves the generated datagrams copying them as the kernel does */
+class SyntheticTransport : public Transport
+{
+public:
+    SyntheticTransport (const std::vector<std::vector<uint8_t>> &datagrams,
+                        uint32_t portId) :
+        _datagrams(datagrams), _portId(portId) {}
+
+    virtual void send (std::span<iovec>) override { _next = 0; }
+
+    virtual size_t peek () override {
+        if (_next == _datagrams.size())
+            throw std::runtime_error("No more datagrams to receive");
+        return _datagrams[_next].size();
+    }
+
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override {
+        const std::vector<uint8_t> &datagram = _datagrams[_next++];
+        std::memcpy(buffer.data(), datagram.data(), datagram.size());
+        return buffer.first(datagram.size());
+    }
+
+    virtual void subscribe (unsigned) override {}
+    virtual uint32_t portId () const override { return _portId; }
+
+private:
+    const std::vector<std::vector<uint8_t>> &_datagrams;
+    uint32_t _portId;
+    size_t _next = 0;
+};
+
+
+/* Netlink fed with the generated datagrams instead of the socket ones */
+class Bench : public Netlink
+{
+public:
+    static constexpr uint32_t portId = 4242;
+    static constexpr uint32_t seq = 1;
+
+    Bench () = default;
+    // Take the whole dump through the session from the transport
+    Bench (const std::vector<std::vector<uint8_t>> &datagrams) :
+        _datagrams(&datagrams) {}
+
+    void dump (bool pipelined) {
+        setPipelined(pipelined);
+        getDevicesAndBridges();
+    }
+
+    // Take the dump the way getDevicesAndBridges() does
+    void parse (const std::vector<std::vector<uint8_t>> &datagrams) {
+        std::vector<Link> results;
+        ErrorCode errorCode = ErrorCode::Success;
+
+        auto headerHandler = [&](nlmsghdr *hdr){
+            if (hdr->nlmsg_type == RTM_NEWLINK)
+                parseLink(hdr, results.emplace_back());
+        };
+
+        for (const auto &datagram : datagrams) {
+            std::span<uint8_t> data (const_cast<uint8_t *>(datagram.data()),
+                                     datagram.size());
+            if (handleReply(data, portId, seq, nullptr, headerHandler,
+                            errorCode))
+                break;
+        }
+        storeLinks(results);
+    }
+
+    /* Take the topology the way 'show' does from the conversation recorded
+     * with 'brctl -record <file> show' */
+    size_t replayShow (const std::string &path) {
+        replay(path);
+        check();
+        getBridges({});
+        return _topology.size();
+    }
+
+    void reset () {
+        _topology.clear();
+        _arena.clear();
+    }
+
+protected:
+    virtual std::unique_ptr<Transport> openTransport () override {
+        if (_datagrams)
+            return std::make_unique<SyntheticTransport>(*_datagrams, portId);
+        return Netlink::openTransport();
+    }
+
+private:
+    const std::vector<std::vector<uint8_t>> *_datagrams = nullptr;
+};
+
+
+struct Measure {
+    std::chrono::nanoseconds elapsed {};
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    template <class Callable>
+    void operator() (Callable &&callable) {
+        const Stats::Snapshot before = Stats::snapshot();
+        const auto start = std::chrono::steady_clock::now();
+
+        callable();
+
+        elapsed += std::chrono::steady_clock::now() - start;
+        const Stats::Snapshot after = Stats::snapshot();
+        allocations += counted(before, after, Stats::Counter::Allocations);
+        bytes += counted(before, after, Stats::Counter::AllocatedBytes);
+    }
+
+    static size_t counted (const Stats::Snapshot &before,
+                           const Stats::Snapshot &after,
+                           Stats::Counter counter) {
+        const size_t i = static_cast<size_t>(counter);
+        return after.counters[i] - before.counters[i];
+    }
+
+    void print (std::string_view phase, size_t links, size_t units) const {
+        std::cout << std::format("{:<8}{:>10}{:>12.1f}{:>14.3f}{:>14.1f}",
+                                 phase, links,
+                                 double(elapsed.count()) / units,
+                                 double(allocations) / units,
+                                 double(bytes) / units)
+                  << std::endl;
+    }
+};
+
+// Run callable with stdout sent to /dev/null
+template <class Callable>
+static void silently (Callable &&callable)
+{
+    std::cout.flush();
+    const int saved = dup(STDOUT_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    callable();
+
+    std::cout.flush();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static void PrintHelp ()
+{
+    std::cout << "Usage: brctl_bench [options]\n"
+                 "options:\n"
+                 "\t-links <n,...>\t\tdump sizes (1000,10000,100000)\n"
+                 "\t-bridge-every <n>\tevery n-th link is a bridge (20)\n"
+                 "\t-port-share <p>\t\tpart of the links being ports (0.5)\n"
+                 "\t-datagram <bytes>\tsize of the datagrams (32768)\n"
+                 "\t-repeat <n>\t\truns of every phase (about 1M links)\n"
+                 "\t-capture <file>\t\treplay 'brctl -record <file> show' "
+                 "instead"
+              << std::endl;
+}
+
+int main (int argc, const char * argv [])
+{
+    std::vector<std::string> args (argv + 1, argv + argc);
+    std::vector<size_t> sizes = {1000, 10000, 100000};
+    DumpGenerator::Shape shape;
+    size_t datagramSize = NetlinkSession::DefaultBufferSize;
+    size_t repeat = 0;
+    std::string capture;
+
+    // The allocations are counted by the allocator brctl has for -stats
+    Stats::enable();
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const bool hasValue = i + 1 < args.size();
+            if (args[i] == "-links" && hasValue) {
+                sizes.clear();
+                std::stringstream sstr (args[++i]);
+                for (std::string size; std::getline(sstr, size, ',');)
+                    sizes.push_back(std::stoul(size));
+            }
+            else if (args[i] == "-bridge-every" && hasValue)
+                shape.bridgeEvery = std::stoul(args[++i]);
+            else if (args[i] == "-port-share" && hasValue)
+                shape.portShare = std::stod(args[++i]);
+            else if (args[i] == "-datagram" && hasValue)
+                datagramSize = std::stoul(args[++i]);
+            else if (args[i] == "-repeat" && hasValue)
+                repeat = std::stoul(args[++i]);
+            else if (args[i] == "-capture" && hasValue)
+                capture = args[++i];
+            else {
+                PrintHelp();
+                return 1;
+            }
+        }
+    } catch (std::exception &e) {
+        PrintHelp();
+        return 1;
+    }
+
+    std::cout << std::format("{:<8}{:>10}{:>12}{:>14}{:>14}",
+                             "phase", "links", "ns/link",
+                             "allocs/link", "bytes/link")
+              << std::endl;
+
+    try {
+        if (! capture.empty()) {
+            Bench bench;
+            Measure replay, show;
+            const size_t links = bench.replayShow(capture);
+            const size_t runs = repeat ? repeat
+                                       : std::max<size_t>(1, 1000000 / links);
+            for (size_t run = 0; run < runs; ++run)
+                replay([&]{ bench.replayShow(capture); });
+            silently([&]{
+                for (size_t run = 0; run < runs; ++run)
+                    show([&]{ bench.show({}); });
+            });
+
+            replay.print("replay", links, links * runs);
+            show.print("show", links, links * runs);
+            return 0;
+        }
+
+        for (size_t links : sizes) {
+            shape.links = links;
+            DumpGenerator generator (Bench::portId, Bench::seq, datagramSize);
+            const auto datagrams = generator.generate(shape);
+            const size_t runs = repeat ? repeat
+                                       : std::max<size_t>(1, 1000000 / links);
+
+            Bench bench;
+            Measure parse, dump, pipeline, show;
+            for (size_t run = 0; run < runs; ++run) {
+                bench.reset();
+                parse([&]{ bench.parse(datagrams); });
+            }
+            // The whole way from the session, a new one every time
+            for (size_t run = 0; run < runs; ++run)
+                dump([&]{ Bench(datagrams).dump(false); });
+            for (size_t run = 0; run < runs; ++run)
+                pipeline([&]{ Bench(datagrams).dump(true); });
+            silently([&]{
+                for (size_t run = 0; run < runs; ++run)
+                    show([&]{ bench.show({}); });
+            });
+
+            parse.print("parse", links, links * runs);
+            dump.print("dump", links, links * runs);
+            pipeline.print("pipeline", links, links * runs);
+            show.print("show", links, links * runs);
+        }
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <string_view>
-#include <unordered_map>
-#include <map>
+#include <istream>
 #include <span>
+#include "Arena.hxx"
+#include "DesiredTopology.hxx"
 #include "Device.hxx"
+#include "ShowPrinter.hxx"
+#include "Topology.hxx"
+#include "Vlan.hxx"
 
 /* Interface are splitted to avoid diamond inheritance in Netlink class */
 
@@ -17,6 +21,7 @@ public:
     static void PrintHelp ();
 
     void run (std::span<const std::string> args);
+    void runBatch (std::istream &input);
 
     /* Interface to implement */
     virtual void show (std::span<const std::string> bridges) = 0;
@@ -26,23 +31,68 @@ public:
                         const std::string &device) = 0;
     virtual void delif (const std::string &bridge,
                         const std::string &device) = 0;
+    virtual void monitor () = 0;
+    virtual void stp (const std::string &bridge, bool on) = 0;
+    // Takes the topology with STP state on its own
+    virtual void showstp (std::span<const std::string> bridges) = 0;
+    virtual void showmacs (const std::string &bridge) = 0;
+    // VLANs of the given bridges and ports, of all of them if none given
+    virtual void showvlans (std::span<const std::string> devices) = 0;
+    virtual void addvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) = 0;
+    virtual void delvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) = 0;
+    /* Change the bridges to be as desired with as few requests as possible.
+     * With prune the bridges not desired are deleted */
+    virtual void apply (std::span<const DesiredBridge> bridges,
+                        bool prune) = 0;
+
+protected:
+    // Options of 'show' given before the bridge names
+    struct ShowOptions {
+        // Print every bridge as soon as its ports are known
+        bool unsorted = false;
+        ShowFormat format = ShowFormat::Text;
+        // Show the bridges of every namespace in /run/netns
+        bool allNetns = false;
+    };
 
 protected:
     virtual void getDevicesAndBridges () = 0;
+    // Take the given bridges (all if none given) with their ports only
+    virtual void getBridges (std::span<const std::string> bridges) {
+        getDevicesAndBridges();
+    }
+
+    /* Batch hooks. Commands between them may be deferred by implementation
+     * until commitBatch() is called */
+    virtual void beginBatch () {}
+    virtual void commitBatch () {}
+
+protected:
+    // Run the command given the way it is in the command line
+    void dispatch (std::span<const std::string> args);
+
+protected:
+    ShowOptions _showOptions;
+
+private:
+    // Take the leading options of 'show' and return the rest
+    std::span<const std::string> parseShowOptions (
+        std::span<const std::string> args);
+    // vlan add|del <device> <vids> [pvid] [untagged]
+    void changeVlans (std::span<const std::string> args);
+    // apply [--prune] <file|->
+    void applyFile (std::span<const std::string> args);
 };
 
 
 class ApplicationData
 {
 protected:
-    bool isMaster (const std::string &dev, const std::string &br) const;
-
-protected:
-    // TODO: try to reimplement _devices and _bridges as unordered_set
-    // with Key and Hash based on Device::name and find()-> instead of operator[]
-    std::unordered_map<std::string, Device> _devices;
-    std::map<std::string, Bridge> _bridges;
+    // Everything the names of the topology point to
+    Arena _arena;
 
-    // bridge <-> device
-    std::unordered_multimap<std::string, std::string> _relations;
+    // Devices and bridges with the relations between them
+    Topology _topology;
 };
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/* Bump allocator keeping everything until destruction. Received netlink
+ * buffers are stored here so the link records may point right into them */
+
+class Arena
+{
+public:
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    // Get at least size bytes to write into. Nothing is taken until commit()
+    std::span<uint8_t> reserve (size_t size) {
+        if (_chunks.empty() || _capacity - _used < size) {
+            _capacity = std::max(size, ChunkSize);
+            _chunks.push_back(std::make_unique<uint8_t[]>(_capacity));
+            _used = 0;
+        }
+        return std::span(_chunks.back().get() + _used, _capacity - _used);
+    }
+
+    // Take size bytes of the last reserved space
+    void commit (size_t size) {
+        // Keep the next allocation aligned as netlink messages are
+        _used += (size + alignof(std::max_align_t) - 1) &
+                 ~(alignof(std::max_align_t) - 1);
+        _used = std::min(_used, _capacity);
+    }
+
+    // Copy the string into the arena. It's still null-terminated there
+    std::string_view intern (std::string_view str) {
+        std::span<uint8_t> space = reserve(str.size() + 1);
+        std::memcpy(space.data(), str.data(), str.size());
+        space[str.size()] = '\0';
+        commit(str.size() + 1);
+        return std::string_view(reinterpret_cast<char *>(space.data()),
+                                str.size());
+    }
+
+    // Release everything. Nothing taken before may be used after that
+    void clear () {
+        _chunks.clear();
+        _capacity = 0;
+        _used = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<uint8_t[]>> _chunks;
+    size_t _capacity = 0;
+    size_t _used = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Device.hxx"
+#include "Result.hxx"
+
+/* In-process API of the netlink backend for those who don't want to spawn
+ * brctl. Nothing is printed and nothing is thrown: every failure comes back
+ * as Error with errno in it if the kernel (or the check) has given one */
+
+namespace brctl {
+
+struct Port
+{
+    std::string name;
+    int index;
+    Operstate operstate;
+};
+
+struct BridgeInfo
+{
+    std::string name;
+    int index;
+    BridgeId bridge_id;
+    bool stp_state;
+    Operstate operstate;
+    std::vector<Port> ports;
+};
+
+class Client
+{
+public:
+    Client ();
+    ~Client ();
+
+    // Bridges with their ports sorted by name, all of them if none given
+    Result<std::vector<BridgeInfo>> show (
+        std::span<const std::string> bridges = {});
+    Result<void> addbr (const std::string &bridge);
+    Result<void> delbr (const std::string &bridge);
+    Result<void> addif (const std::string &bridge, const std::string &device);
+    Result<void> delif (const std::string &bridge, const std::string &device);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
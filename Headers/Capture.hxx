@@ -0,0 +1,92 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "Transport.hxx"
+
+/* Capture file of a netlink conversation. The header is followed by the
+ * records, every one holds a datagram as it was sent or received:
+ *
+ *   FileHeader | RecordHeader datagram [pad] | RecordHeader datagram ...
+ *
+ * Records are padded to NLMSG_ALIGNTO so the mapped datagrams may be parsed
+ * right in place. The sequence numbers of a session are predictable so the
+ * replies match the replayed requests as long as the portId is the same */
+
+namespace Capture
+{
+    // "BRNL" read as little-endian
+    static constexpr uint32_t Magic = 0x4c4e5242;
+    static constexpr uint16_t Version = 1;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t portId;
+        uint32_t reserved2;
+    };
+
+    enum class Direction : uint8_t { Sent, Received, Overrun };
+
+    struct RecordHeader {
+        uint32_t length;
+        Direction direction;
+        uint8_t reserved [3];
+    };
+}
+
+
+/* Pass everything to the wrapped transport and write it to the file */
+class Recorder : public Transport
+{
+public:
+    Recorder (std::unique_ptr<Transport> transport, const std::string &path);
+
+    /* Transport methods implementation */
+    virtual void send (std::span<iovec> messages) override;
+    virtual size_t peek () override;
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override;
+    virtual void subscribe (unsigned group) override;
+    virtual uint32_t portId () const override;
+
+private:
+    void write (Capture::Direction direction,
+                std::span<const iovec> datagram);
+
+private:
+    std::unique_ptr<Transport> _transport;
+    std::ofstream _file;
+};
+
+
+/* Serve the replies from the mapped capture file without copying them */
+class Replayer : public Transport
+{
+public:
+    Replayer (const std::string &path);
+    ~Replayer ();
+
+    Replayer (const Replayer &) = delete;
+    Replayer & operator= (const Replayer &) = delete;
+
+    /* Transport methods implementation */
+    virtual void send (std::span<iovec> messages) override;
+    virtual size_t peek () override;
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override;
+    virtual void subscribe (unsigned group) override {}
+    virtual uint32_t portId () const override { return _portId; }
+
+private:
+    // Find the next record, its direction is checked
+    std::span<uint8_t> next (Capture::Direction expected);
+    // Take the record found by next()
+    void advance (std::span<uint8_t> record);
+
+private:
+    std::span<uint8_t> _map;
+    size_t _offset = 0;
+    uint32_t _portId = 0;
+};
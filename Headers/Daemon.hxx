@@ -0,0 +1,80 @@
+#pragma once
+
+#include <sys/types.h>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FileDescriptor.hxx"
+#include "Netlink.hxx"
+
+/* Resident brctl. The topology is taken once and kept current by the link
+ * notifications, clients connect to a Unix socket and have their commands
+ * run there over the one netlink session of the daemon. The socket is in
+ * the abstract namespace which belongs to the network namespace, so every
+ * namespace may have its own daemon and a client finds the one of its own.
+ *
+ * A client sends the length of the request and the words of the command,
+ * each followed by a null. The daemon runs the command with its output
+ * going to the client, then sends a byte of the exit status and closes the
+ * connection */
+
+class Daemon
+{
+public:
+    // Name of the abstract socket, without the leading null
+    static constexpr std::string_view SocketName = "brctl";
+    // Longest command a client may send
+    static constexpr size_t MaxRequestSize = 4096;
+    /* A client taking longer than that to send the request and take the
+     * reply is dropped, in milliseconds */
+    static constexpr int ClientTimeout = 1000;
+    // Clients served at once, the rest wait to be accepted
+    static constexpr size_t MaxClients = 64;
+
+public:
+    // Check if the daemon runs the command rather than the client
+    static bool serves (std::span<const std::string> args);
+
+    /* Run the command by the daemon of the namespace and copy what it
+     * prints to stdout. Returns the exit status of the command, nothing if
+     * there's no daemon or it's run by someone other than root or us */
+    static std::optional<int> forward (std::span<const std::string> args);
+
+public:
+    // Takes the socket, throws if another daemon holds it
+    Daemon ();
+
+    // Serve the clients until killed
+    void run ();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Client {
+        FileDescriptor fd;
+        Clock::time_point deadline;
+        // The length and the request while it's received, then the reply
+        std::string data;
+        // Bytes of the data received or sent
+        size_t done = 0;
+        bool replying = false;
+    };
+
+private:
+    // Take what the client has sent or send it what's left. False when done
+    bool serve (Client &client);
+    // Run the command and return its output followed by the status
+    std::string execute (int client, std::span<const std::string> args);
+    // Only the owner of the daemon and root may change the bridges
+    bool mayChange (int client) const;
+
+private:
+    Netlink _netlink;
+    FileDescriptor _listener;
+    uid_t _owner;
+    std::vector<Client> _clients;
+};
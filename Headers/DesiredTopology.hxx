@@ -0,0 +1,26 @@
+#pragma once
+
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+/* Bridges as they should be, read from a topology file of 'apply'. A line
+ * describes a bridge completely, '#' starts a comment:
+ *
+ *   bridge br0 stp on ports eth0 eth1
+ *   bridge br1 ports eth2
+ *   bridge br2
+ *
+ * STP state is left as it is unless given, a bridge without 'ports' has
+ * none. A port may belong to one bridge only */
+
+struct DesiredBridge
+{
+    std::string name;
+    std::optional<bool> stp;
+    std::vector<std::string> ports;
+};
+
+// Throws on the first malformed line
+std::vector<DesiredBridge> parseDesiredTopology (std::istream &input);
@@ -1,12 +1,40 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <format>
+#include <array>
+#include <cinttypes>
 
+/* Link records are cheap to copy: the names point into the Arena of
+ * ApplicationData and everything else is kept raw until it's printed */
+
+// Mirrors IF_OPER_* values
+enum class Operstate : uint8_t {
+    Unknown, NotPresent, Down, LowerLayerDown, Testing, Dormant, Up
+};
+
+constexpr std::string_view operstateName (Operstate state)
+{
+    constexpr std::string_view names []
+        { "UNKNOWN", "NOTPRESENT", "DOWN", "LOWERLAYERDOWN",
+          "TESTING", "DORMANT", "UP"};
+    return state <= Operstate::Up ? names[static_cast<uint8_t>(state)]
+                                  : names[0];
+}
+
+// Two bytes of priority followed by MAC address, as ifla_bridge_id is
+using BridgeId = std::array<uint8_t, 8>;
+
+inline std::string formatBridgeId (const BridgeId &id)
+{
+    return std::format("{:02x}{:02x}.{:02x}{:02x}{:02x}{:02x}{:02x}{:02x}",
+                       id[0], id[1], id[2], id[3], id[4], id[5], id[6], id[7]);
+}
 
 struct Device
 {
-    std::string name;
-    std::string operstate;
+    std::string_view name;
+    Operstate operstate;
     int index;
 
 public:
@@ -15,29 +43,36 @@ public:
     }
 
     operator std::string() {
-        return std::format("{}: {}: {}", index, name, operstate);
+        return std::format("{}: {}: {}", index, name, operstateName(operstate));
     }
 };
 
 struct Bridge : public Device
 {
-    std::string bridge_id;
+    BridgeId bridge_id;
     bool stp_state;
 
 public:
-    constexpr Bridge() : Device{"", "", 0}, bridge_id{""}, stp_state(false) {}
+    constexpr Bridge() : Device{"", Operstate::Unknown, 0},
+                         bridge_id{}, stp_state(false) {}
 
     Bridge(const Device &dev) :
-        Device{dev} {}
-
-    bool isSane () const {
-        return Device::isSane() && bridge_id.length();
-    }
+        Device{dev}, bridge_id{}, stp_state(false) {}
 
     operator std::string() {
         return std::format("{}: {}: {} STP={} {}",
-                           index, name, bridge_id,
-                           (stp_state ? "ON" : "OFF"), operstate);
+                           index, name, formatBridgeId(bridge_id),
+                           (stp_state ? "ON" : "OFF"),
+                           operstateName(operstate));
     }
 };
 
+// Everything known about a link: a device or a bridge and its master if any
+struct Link : public Bridge
+{
+    uint32_t master = 0;
+    bool bridge = false;
+
+public:
+    bool isBridge () const { return bridge && isSane(); }
+};
@@ -1,12 +1,26 @@
 #pragma once
 
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include "Application.hxx"
-#include <filesystem>
+#include "FileDescriptor.hxx"
 
-/* Fallback application based on ioctl and sysfs */
+/* Fallback application based on ioctl and sysfs. Every attribute is read
+ * with one openat() relative to the interface directory in /sys/class/net
+ * and one read(), the interfaces are spread over a few threads. Changes
+ * are made with the bridge ioctls over one control socket */
 
 class Fallback : public Application, public ApplicationData
 {
+public:
+    // Fewer interfaces are read on the calling thread only
+    static constexpr size_t ParallelThreshold = 256;
+    static constexpr unsigned MaxThreads = 8;
+
 public:
     virtual void show (std::span<const std::string> bridges) override;
     virtual void addbr (const std::string &bridge) override;
@@ -15,13 +29,58 @@ public:
                         const std::string &device) override;
     virtual void delif (const std::string &bridge,
                         const std::string &device) override;
+    virtual void monitor () override;
+    virtual void stp (const std::string &bridge, bool on) override;
+    virtual void showstp (std::span<const std::string> bridges) override;
+    virtual void showmacs (const std::string &bridge) override;
+    virtual void showvlans (std::span<const std::string> devices) override;
+    virtual void addvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) override;
+    virtual void delvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) override;
+    virtual void apply (std::span<const DesiredBridge> bridges,
+                        bool prune) override;
 
 protected:
     virtual void getDevicesAndBridges () override;
+    // Read only the given bridges and their ports
+    virtual void getBridges (std::span<const std::string> bridges) override;
+
+private:
+    // What was read of one interface directory
+    struct Entry {
+        Link link;
+        // The directory may be gone or not be an interface at all
+        bool present = false;
+        // Names listed in brif/ of a bridge
+        std::vector<std::string> ports;
+    };
 
 private:
-    Device getDevice (const std::filesystem::directory_entry &dir);
-    Bridge getBridge (const std::filesystem::directory_entry &dir);
+    int sysfs ();
+    int control ();
+    // ifindex of the device, 0 if there is no such device
+    int indexOf (const std::string &name);
+    // Bridge ioctl on the control socket, returns errno or 0
+    int bridgeIoctl (unsigned long request, const std::string &bridge,
+                     int ifindex = 0);
+
+    // Entries for the names, the names are interned in the arena
+    std::vector<Entry> makeEntries (std::span<const std::string> names);
+    void readEntries (std::span<Entry> entries);
+    // root is the descriptor of /sys/class/net
+    void readEntry (Entry &entry, int root);
+    void store (std::span<const Entry> entries);
+    // Set the masters of the ports listed by the bridges
+    void linkPorts (std::span<const Entry> entries);
+
     template <class T>
-    T readFile (const std::filesystem::path &path);
+    static T parseAttribute (std::string_view value);
+
+private:
+    FileDescriptor _sysfs;
+    // AF_LOCAL socket for the ioctls, opened once
+    FileDescriptor _control;
+    // ifindexes looked up so far. A batch needs no scan of sysfs then
+    std::unordered_map<std::string, int> _indexes;
 };
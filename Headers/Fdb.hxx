@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cinttypes>
+#include <span>
+#include <vector>
+
+#include "Output.hxx"
+#include "Topology.hxx"
+
+/* Forwarding database entries of a bridge as fixed-size records, so even
+ * millions of them take one allocation and no strings. Ports are kept as
+ * ifindexes and named only when printed */
+
+struct FdbEntry
+{
+    int32_t port;
+    // Hundredths of a second since the entry was updated
+    uint32_t ageing;
+    uint8_t mac [6];
+    // 0 if the entry isn't bound to a VLAN
+    uint16_t vlan;
+    // NUD_* of the entry: permanent ones are local, noarp ones are static
+    uint16_t state;
+};
+
+// Sort by port, then by MAC and VLAN, in linear time and one extra array
+void sortFdb (std::vector<FdbEntry> &entries);
+
+// The report of 'showmacs', a row per entry
+void printFdb (Output &out, const Topology &topology,
+               std::span<const FdbEntry> entries);
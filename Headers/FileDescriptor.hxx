@@ -0,0 +1,37 @@
+#pragma once
+
+#include <unistd.h>
+#include <utility>
+
+/* RAII-structure for a file descriptor of any kind */
+
+class FileDescriptor
+{
+public:
+    FileDescriptor () = default;
+    explicit FileDescriptor (int fd) : _fd(fd) {}
+
+    ~FileDescriptor () {
+        if (_fd >= 0)
+            close(_fd);
+    }
+
+    // forbid copying
+    FileDescriptor (const FileDescriptor &) = delete;
+    FileDescriptor & operator= (const FileDescriptor &) = delete;
+
+    // allow moving
+    FileDescriptor (FileDescriptor &&other) noexcept :
+        _fd(std::exchange(other._fd, -1)) {}
+
+    FileDescriptor & operator= (FileDescriptor &&other) noexcept {
+        std::swap(_fd, other._fd);
+        return *this;
+    }
+
+    inline int fd () const { return _fd; }
+    inline explicit operator bool () const { return _fd >= 0; }
+
+private:
+    int _fd = -1;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Socket.hxx"
+#include "Stats.hxx"
+#include "Transport.hxx"
+
+/* Live AF_NETLINK socket bound to the kernel */
+
+class KernelTransport : public Transport
+{
+public:
+    // Socket buffer sizes, the same iproute2 uses by default
+    struct Options {
+        int sndBufSize = 32768;
+        int rcvBufSize = 1024 * 1024;
+    };
+
+public:
+    KernelTransport ();
+    KernelTransport (const Options &options);
+
+    /* Transport methods implementation */
+    virtual void send (std::span<iovec> messages) override;
+    virtual size_t peek () override;
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override;
+    virtual void subscribe (unsigned group) override;
+    virtual uint32_t portId () const override { return _address.nl_pid; }
+    virtual int fd () const override { return _sock.fd(); }
+
+private:
+    // Socket setup is timed from socket() on
+    KernelTransport (const Options &options, const Stats::Timer &);
+    void setOptsMakeChecks (const Options &options);
+    // Try to exceed the system limits first as it needs CAP_NET_ADMIN
+    void setBufferSize (int forceOption, int option, int size,
+                        const char *name);
+
+private:
+    Socket _sock;
+    sockaddr_nl _address;
+};
@@ -1,9 +1,21 @@
 #pragma once
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "Application.hxx"
+#include "Fdb.hxx"
+#include "Stp.hxx"
 #include "_NetlinkImpl.hxx"
 
 class Netlink : public _NetlinkImpl, public Application
 {
+public:
+    // Namespaces dumped at once by show --all-netns
+    static constexpr size_t MaxNetnsWorkers = 16;
+
 public:
     /* Application methods implementation */
     virtual void show (std::span<const std::string> bridges) override;
@@ -13,11 +25,156 @@ public:
                         const std::string &device) override;
     virtual void delif (const std::string &bridge,
                         const std::string &device) override;
+    virtual void monitor () override;
+    virtual void stp (const std::string &bridge, bool on) override;
+    virtual void showstp (std::span<const std::string> bridges) override;
+    virtual void showmacs (const std::string &bridge) override;
+    virtual void showvlans (std::span<const std::string> devices) override;
+    virtual void addvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) override;
+    virtual void delvlans (const std::string &device,
+                           std::span<const VlanRange> vlans) override;
+    virtual void apply (std::span<const DesiredBridge> bridges,
+                        bool prune) override;
 
     // Check if netlink works
     bool check();
 
+    /* The topology taken once and kept current by the notifications, so
+     * show answers from it without asking the kernel. See Daemon */
+    void becomeResident ();
+    // Descriptor which is readable while notifications are pending
+    int eventsFd ();
+    // Apply the pending notifications without waiting for more
+    void applyEvents ();
+
 protected:
     /* Application methods */
     virtual void getDevicesAndBridges() override;
+    virtual void getBridges (std::span<const std::string> bridges) override;
+    virtual void beginBatch () override;
+    virtual void commitBatch () override;
+
+    /* STP state is taken in the same pass if asked for: of the bridge from
+     * IFLA_INFO_DATA, of the port from IFLA_PROTINFO */
+    void parseLink (const nlmsghdr *hdr, Link &link,
+                    BridgeStp *bridgeStp = nullptr,
+                    PortStp *portStp = nullptr);
+    void storeLinks (std::vector<Link> &results);
+
+private:
+    // Topology of one namespace taken by its own Netlink
+    struct NetnsTopology {
+        std::string name;
+        std::unique_ptr<Netlink> netlink;
+        std::string error;
+    };
+
+private:
+    // Request dumping all the links, filters may be put into it
+    struct DumpRequest : public Message::Request<Message::DumpLinks> {
+        DumpRequest (uint32_t extMask = RTEXT_FILTER_VF |
+                                        RTEXT_FILTER_SKIP_STATS);
+    };
+
+private:
+    // Print the bridges of the topology taken by getBridges()
+    void printBridges (std::span<const std::string> bridges,
+                       ShowPrinter &printer, Output &out);
+    // Take the bridges of every namespace on a few threads
+    void getNetnsBridges (std::span<const std::string> bridges);
+
+    // Put IFLA_LINKINFO with the bridge kind into a request of any layout,
+    // with the STP state if it's given
+    template <class TBuilder>
+    static void addBridgeKind (TBuilder &request,
+                               std::optional<bool> stp = std::nullopt) {
+        auto info = request.template nest<Message::LinkInfo>();
+        info.template put<Message::InfoKind>("bridge");
+        if (stp) {
+            auto data = info.template nest<Message::BridgeData>();
+            data.template put<Message::StpState>(*stp);
+        }
+    }
+    // Take the ports of the bridge. False if the kernel can't filter them
+    bool getPorts (const Link &br);
+    // Parses a link of the dump in place of parseLink()
+    using LinkParser = std::function<void(const nlmsghdr *hdr, Link &link)>;
+    // Returns false if the kernel rejected the filters of the request
+    bool dumpLinks (DumpRequest &request,
+                    std::vector<Link> &results,
+                    const LinkParser &parse = nullptr);
+
+    // Take the bridges and their ports with STP state of every one
+    void getStp (std::unordered_map<int, BridgeStp> &bridges,
+                 std::unordered_map<int, PortStp> &ports);
+    void parseBridgeStp (const rtattr *data, BridgeStp &stp) const;
+    void parsePortStp (const rtattr *protinfo, PortStp &stp) const;
+
+    // Take the forwarding database of the bridge
+    void dumpFdb (const Link &br, std::vector<FdbEntry> &entries);
+
+    // VLANs of IFLA_AF_SPEC of an AF_BRIDGE message
+    void parseVlans (const nlmsghdr *hdr,
+                     std::vector<VlanRange> &vlans) const;
+    // RTM_SETLINK or RTM_DELLINK of the VLANs, each range in two entries
+    void submitVlans (uint16_t type, const std::string &device,
+                      std::span<const VlanRange> vlans);
+
+    /* Topology kept current by link notifications */
+    using ChangeCallback = std::function<void(const Link *before,
+                                              const Link *after)>;
+    // Subscribe to notifications and take the topology
+    void startEvents ();
+    // Wait for notifications and apply them to the topology
+    void handleEvents (ChangeCallback onChange);
+    // Report the ports of the bridge removed from it
+    void detachPorts (int bridge, ChangeCallback onChange);
+    // Take the topology again and report what has changed meanwhile
+    void resync (ChangeCallback onChange);
+    // Take the topology again dropping everything kept in the arena
+    void reload ();
+    void printChange (const Link *before, const Link *after);
+
+    // Find the link in the batch topology or ask the kernel about it
+    std::optional<Link> resolve (const std::string &name);
+    std::optional<Link> lookup (const std::string &name);
+
+    /* Build the request with build(builder) and send it right away, or
+     * build it into the batch to be sent by commitBatch() taking the space
+     * given there */
+    template <class TLayout, class Build>
+    void submit (uint16_t type, uint16_t flags, Build &&build,
+                 ErrCallback errHandle, size_t space = TLayout::maxSize);
+    // Send deferred requests and take the bridges created by them
+    void flush ();
+
+    // Commands making the topology as desired, in the order to run them
+    std::vector<std::vector<std::string>> plan (
+        std::span<const DesiredBridge> bridges, bool prune) const;
+
+private:
+    // Filled by getNetnsBridges() in the order of the names
+    std::vector<NetnsTopology> _netns;
+
+    // Only the bridges are taken yet, see getPorts()
+    bool _portsPending = false;
+
+    // The topology before resync() while it reports the changes
+    const Topology *_previous = nullptr;
+
+    // Topology is kept by notifications, see becomeResident()
+    bool _resident = false;
+    // Notifications and lookups applied since the topology was taken
+    size_t _eventsApplied = 0;
+
+    bool _batching = false;
+    // Requests deferred until commitBatch() and their ACK handlers
+    Message::Batch _batch;
+    std::vector<ErrCallback> _batchErrHandles;
+    /* Wraps the ACK handlers of the requests submitted while it's set, so
+     * apply() learns which command they belong to */
+    std::function<ErrCallback (ErrCallback)> _wrapErrHandle;
+    // Bridges created in the batch which indexes are unknown yet
+    std::unordered_set<std::string> _created;
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <linux/netlink.h>
+#include <sys/uio.h>
+#include <cinttypes>
+#include <memory>
+#include <vector>
+#include <span>
+
+#include "Arena.hxx"
+#include "Transport.hxx"
+
+/* Long-lived connection with the kernel. Keeps the transport, the receive
+ * buffer allocated once and the counter of sequence numbers so the requests
+ * may be sent one after another without reopening anything */
+
+class NetlinkSession
+{
+public:
+    // Thrown by receive() if the kernel dropped messages for the socket
+    using Overrun = Transport::Overrun;
+
+    /* The kernel makes dump datagrams as big as the largest buffer offered
+     * to it, up to about 32 KiB. Fewer datagrams mean fewer syscalls */
+    static constexpr size_t DefaultBufferSize = 32 * 1024;
+
+public:
+    // Talk to the kernel over a new socket
+    NetlinkSession ();
+    NetlinkSession (std::unique_ptr<Transport> transport);
+
+    // Join the multicast group, e.g. RTNLGRP_LINK
+    void subscribe (unsigned group);
+
+    // Give the message the next sequence number and return it
+    uint32_t stamp (nlmsghdr &hdr);
+
+    // Send a bunch of messages with a single sendmsg()
+    void send (std::span<iovec> messages);
+
+    /* Receive the next datagram into the session buffer or the given one
+     * which grow if they're too small, or into the arena so it outlives the
+     * call. Replayed datagrams may stay in the transport memory */
+    std::span<uint8_t> receive ();
+    std::span<uint8_t> receive (std::vector<uint8_t> &buffer);
+    std::span<uint8_t> receive (Arena &keep);
+
+    // Size offered to the kernel for the datagrams
+    inline size_t bufferSize () const { return _rcvBuffer.size(); }
+
+    // Check if the message is a reply to a request with seq in [first, last]
+    bool isReply (const nlmsghdr *hdr, uint32_t first, uint32_t last) const;
+    bool isReply (const nlmsghdr *hdr, uint32_t seq) const {
+        return isReply(hdr, seq, seq);
+    }
+
+    inline uint32_t portId () const { return _transport->portId(); }
+    inline int fd () const { return _transport->fd(); }
+
+private:
+    std::unique_ptr<Transport> _transport;
+    std::vector<uint8_t> _rcvBuffer;
+    uint32_t _seq;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* Named network namespaces the way 'ip netns' keeps them: files in
+ * /run/netns the namespaces are bind-mounted to */
+
+namespace Netns
+{
+    constexpr const char *RunDir = "/run/netns";
+
+    // Names of the namespaces sorted, empty if there are none
+    std::vector<std::string> list ();
+
+    // Move the calling thread into the namespace given by name or by path.
+    // Sockets opened afterwards belong to that namespace
+    void enter (const std::string &name);
+}
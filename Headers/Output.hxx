@@ -0,0 +1,53 @@
+#pragma once
+
+#include <unistd.h>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/* Text formatted right into one growable buffer and written to the file
+ * descriptor with a few large writes: when the buffer gets big or on
+ * flush(). Whatever is left is written on destruction */
+
+class Output
+{
+public:
+    static constexpr size_t FlushSize = 64 * 1024;
+
+public:
+    explicit Output (int fd = STDOUT_FILENO);
+    ~Output ();
+
+    Output (const Output &) = delete;
+    Output & operator= (const Output &) = delete;
+
+    template <class... Args>
+    void print (std::format_string<Args...> fmt, Args &&...args) {
+        std::format_to(std::back_inserter(_buffer), fmt,
+                       std::forward<Args>(args)...);
+        if (_buffer.size() >= FlushSize)
+            flush();
+    }
+
+    void put (std::string_view text) {
+        _buffer.append(text);
+        if (_buffer.size() >= FlushSize)
+            flush();
+    }
+
+    // Copy the object representation as it is
+    template <class T>
+    void putBytes (const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put(std::string_view(reinterpret_cast<const char *>(&value),
+                             sizeof(value)));
+    }
+
+    void flush ();
+
+private:
+    int _fd;
+    std::string _buffer;
+};
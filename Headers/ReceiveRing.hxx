@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cinttypes>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <vector>
+
+/* Buffers passed around between the receiver thread and the parser. The
+ * receiver fills the drained ones, the parser takes the filled ones in order
+ * and gives them back, so nothing is copied or allocated per datagram */
+
+class ReceiveRing
+{
+public:
+    ReceiveRing (size_t slots, size_t bufferSize);
+
+    /* Receiver side */
+    // Wait for a drained buffer. Returns nullptr if the ring is closed
+    std::vector<uint8_t> * acquire ();
+    // Pass the datagram received into the acquired buffer to the parser
+    void publish (std::span<uint8_t> data);
+    // Pass the failure to the parser instead of the next datagram
+    void fail (std::exception_ptr error);
+
+    /* Parser side */
+    // Wait for the next datagram. Rethrows the failure of the receiver
+    std::span<uint8_t> consume ();
+    // Give the consumed buffer back
+    void release ();
+    // Make the receiver stop
+    void close ();
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _drained;
+    std::condition_variable _filled;
+
+    std::vector<std::vector<uint8_t>> _buffers;
+    std::vector<std::span<uint8_t>> _data;
+
+    // Counters only grow, the slot is the counter modulo the ring size
+    size_t _acquired = 0;
+    size_t _published = 0;
+    size_t _consumed = 0;
+    size_t _released = 0;
+
+    std::exception_ptr _error;
+    bool _closed = false;
+};
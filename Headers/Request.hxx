@@ -1,23 +1,342 @@
 #pragma once
 
+#include <linux/if.h>
+#include <linux/if_bridge.h>
+#include <linux/neighbour.h>
 #include <linux/rtnetlink.h>
-#include <ctime>
+#include <algorithm>
+#include <array>
 #include <cinttypes>
+#include <cstring>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/* Requests are built after layouts known at compile time: a layout names
+ * the family header and the attributes a request may hold, so the most
+ * space the request takes is a constant. Putting an attribute the layout
+ * doesn't have doesn't compile, nested attributes are written through
+ * scoped nests which set their lengths on destruction:
+ *
+ *   Message::Request<Message::NewBridge> rq (RTM_NEWLINK, flags);
+ *   rq.put<Message::IfName>("br0");
+ *   {
+ *       auto info = rq.nest<Message::LinkInfo>();
+ *       info.put<Message::InfoKind>("bridge");
+ *   }
+ */
 
 namespace Message {
 
-struct LinkRequest
+/* Attribute layouts */
+
+// Attribute holding a value as it is
+template <uint16_t Type, class T>
+    requires std::is_trivially_copyable_v<T>
+struct Fixed
+{
+    using Attribute = Fixed;
+    using Value = T;
+    static constexpr uint16_t type = Type;
+    static constexpr size_t space = RTA_SPACE(sizeof(T));
+};
+
+// String of at most MaxLength characters with or without the null
+template <uint16_t Type, size_t MaxLength, bool Terminated = true>
+struct String
+{
+    using Attribute = String;
+    using Value = std::string_view;
+    static constexpr uint16_t type = Type;
+    static constexpr size_t maxLength = MaxLength;
+    static constexpr bool terminated = Terminated;
+    static constexpr size_t space = RTA_SPACE(MaxLength + Terminated);
+};
+
+// Attribute A which may be put up to N times in a row
+template <class A, size_t N>
+struct Repeated
+{
+    using Attribute = A;
+    static constexpr size_t space = A::space * N;
+};
+
+// Attribute holding the children attributes, each at most once unless
+// repeated
+template <uint16_t Type, class... Children>
+struct Nested
+{
+    using Attribute = Nested;
+    static constexpr uint16_t type = Type;
+    static constexpr size_t space = RTA_SPACE(0) + (Children::space + ... + 0);
+
+    template <class A>
+    static constexpr bool has =
+        (std::is_same_v<A, typename Children::Attribute> || ...);
+};
+
+// Request with the family header and the attributes, each at most once
+// unless repeated
+template <class FamilyHdr, class... Attrs>
+struct Layout
+{
+    using Family = FamilyHdr;
+    static constexpr size_t maxSize =
+        NLMSG_SPACE(sizeof(FamilyHdr)) + (Attrs::space + ... + 0);
+
+    template <class A>
+    static constexpr bool has =
+        (std::is_same_v<A, typename Attrs::Attribute> || ...);
+};
+
+
+/* Links */
+
+using IfName = String<IFLA_IFNAME, IFNAMSIZ - 1>;
+using ExtMask = Fixed<IFLA_EXT_MASK, uint32_t>;
+using Master = Fixed<IFLA_MASTER, uint32_t>;
+// The kernel compares the kind without the null
+using InfoKind = String<IFLA_INFO_KIND, IFNAMSIZ - 1, false>;
+using StpState = Fixed<IFLA_BR_STP_STATE, uint32_t>;
+using BridgeData = Nested<IFLA_INFO_DATA, StpState>;
+using LinkInfo = Nested<IFLA_LINKINFO, InfoKind, BridgeData>;
+
+// Filters of a dump are optional
+using DumpLinks = Layout<ifinfomsg, ExtMask, Master, LinkInfo>;
+using GetLink = Layout<ifinfomsg, IfName, ExtMask>;
+using NewBridge = Layout<ifinfomsg, IfName, LinkInfo>;
+using DelBridge = Layout<ifinfomsg, LinkInfo>;
+// The bridge may be given by name, e.g. right after it's created
+using SetBridge = Layout<ifinfomsg, IfName, LinkInfo>;
+using SetMaster = Layout<ifinfomsg, Master>;
+using Probe = Layout<ifinfomsg>;
+
+
+/* Bridge VLANs */
+
+// The bridge itself rather than its master takes BRIDGE_FLAGS_SELF
+using BridgeFlags = Fixed<IFLA_BRIDGE_FLAGS, uint16_t>;
+using VlanInfo = Fixed<IFLA_BRIDGE_VLAN_INFO, bridge_vlan_info>;
+// No id takes more than one entry, so this holds any set of VLANs
+static constexpr size_t MaxVlanInfos = 4094;
+using BridgeSpec = Nested<IFLA_AF_SPEC, BridgeFlags,
+                          Repeated<VlanInfo, MaxVlanInfos>>;
+
+// RTM_SETLINK adds the VLANs, RTM_DELLINK deletes them
+using SetVlans = Layout<ifinfomsg, BridgeSpec>;
+
+// Space of SetVlans holding the given number of VlanInfo entries at most
+constexpr size_t setVlansSpace (size_t entries)
+{
+    return SetVlans::maxSize - VlanInfo::space * (MaxVlanInfos - entries);
+}
+
+
+/* Neighbours */
+
+using NeighMaster = Fixed<NDA_MASTER, uint32_t>;
+
+using DumpNeigh = Layout<ndmsg, NeighMaster>;
+
+
+/* Appends attributes to the message. The space behind the message must be
+ * zeroed and hold the most the layout allows unless fewer attributes are
+ * put. It runs out if some attribute is put twice or the message was given
+ * less space than put in it, that is checked at runtime */
+class Writer
+{
+protected:
+    Writer (nlmsghdr *hdr, const uint8_t *end) : _hdr(hdr), _end(end) {}
+
+    template <class A>
+    void write (const typename A::Value &value) {
+        rtattr *attr = append(A::type, A::space);
+
+        if constexpr (std::is_same_v<typename A::Value, std::string_view>) {
+            if (value.size() > A::maxLength)
+                throw std::length_error(
+                    std::format("{} is longer than {} characters",
+                                value, A::maxLength));
+            std::memcpy(RTA_DATA(attr), value.data(), value.size());
+            attr->rta_len = RTA_LENGTH(value.size() + A::terminated);
+        }
+        else {
+            std::memcpy(RTA_DATA(attr), &value, sizeof(value));
+            attr->rta_len = RTA_LENGTH(sizeof(value));
+        }
+        _hdr->nlmsg_len = NLMSG_ALIGN(_hdr->nlmsg_len) +
+                          RTA_ALIGN(attr->rta_len);
+    }
+
+    // Attribute at the end of the message which may take up to space
+    rtattr * append (uint16_t type, size_t space) {
+        uint8_t *tail = reinterpret_cast<uint8_t *>(_hdr) +
+                        NLMSG_ALIGN(_hdr->nlmsg_len);
+        if (tail + space > _end)
+            throw std::logic_error(
+                std::format("Attribute {} is put more times than the layout "
+                            "of message {} allows", type, _hdr->nlmsg_type));
+
+        rtattr *attr = reinterpret_cast<rtattr *>(tail);
+        attr->rta_type = type;
+        return attr;
+    }
+
+protected:
+    nlmsghdr *_hdr;
+    const uint8_t *_end;
+};
+
+
+/* Nested attribute open while the object lives */
+template <class TNested>
+class Nest : public Writer
 {
-    nlmsghdr hdr;
-    ifinfomsg ifi;
-    uint8_t buffer [1024];
+public:
+    Nest (nlmsghdr *hdr, const uint8_t *end) :
+        Writer(hdr, end),
+        // The children check their own space as they're put
+        _attr(append(TNested::type, RTA_SPACE(0)))
+    {
+        _attr->rta_len = RTA_LENGTH(0);
+        _hdr->nlmsg_len = NLMSG_ALIGN(_hdr->nlmsg_len) + RTA_LENGTH(0);
+    }
+
+    ~Nest () {
+        _attr->rta_len = reinterpret_cast<uint8_t *>(_hdr) +
+                         _hdr->nlmsg_len - reinterpret_cast<uint8_t *>(_attr);
+    }
+
+    Nest (const Nest &) = delete;
+    Nest & operator= (const Nest &) = delete;
+
+    template <class A>
+        requires (TNested::template has<A>)
+    void put (const typename A::Value &value) {
+        write<A>(value);
+    }
+
+    template <class A>
+        requires (TNested::template has<A>)
+    [[nodiscard]] Nest<A> nest () {
+        return Nest<A>(_hdr, _end);
+    }
+
+private:
+    rtattr *_attr;
+};
+
+
+/* Builds a message of the layout in the given space */
+template <class TLayout>
+class Builder : public Writer
+{
+public:
+    using Family = typename TLayout::Family;
+
+public:
+    /* The space must be zeroed. It may hold less than TLayout::maxSize
+     * bytes when fewer attributes are put, more than it holds throw */
+    Builder (std::span<uint8_t> space, uint16_t type, uint16_t flags) :
+        Writer(reinterpret_cast<nlmsghdr *>(space.data()),
+               space.data() + std::min(space.size(), TLayout::maxSize))
+    {
+        // seq is given by the session
+        *_hdr = {.nlmsg_len = NLMSG_LENGTH(sizeof(Family)),
+                 .nlmsg_type = type,
+                 .nlmsg_flags = flags};
+    }
+
+    inline nlmsghdr & header () { return *_hdr; }
+    inline Family & family () {
+        return *reinterpret_cast<Family *>(NLMSG_DATA(_hdr));
+    }
+
+    template <class A>
+        requires (TLayout::template has<A>)
+    void put (const typename A::Value &value) {
+        write<A>(value);
+    }
+
+    template <class A>
+        requires (TLayout::template has<A>)
+    [[nodiscard]] Nest<A> nest () {
+        return Nest<A>(_hdr, _end);
+    }
+};
+
+
+template <size_t Size>
+struct Storage
+{
+    alignas(nlmsghdr) std::array<uint8_t, Size> _storage {};
+};
+
+/* Single request with the space of its layout in place */
+template <class TLayout>
+class Request : private Storage<TLayout::maxSize>, public Builder<TLayout>
+{
+public:
+    Request (uint16_t type, uint16_t flags) :
+        Builder<TLayout>(this->_storage, type, flags) {}
+
+    // The builder points into the object
+    Request (const Request &) = delete;
+    Request & operator= (const Request &) = delete;
+};
+
+
+/* Messages written back to back into one buffer, so any run of them may
+ * be sent as a single piece */
+class Batch
+{
+public:
+    /* The builder is valid until the next message is added. The message
+     * may be given less space than its layout allows at most */
+    template <class TLayout>
+    Builder<TLayout> add (uint16_t type, uint16_t flags,
+                          size_t space = TLayout::maxSize) {
+        trim();
+        _offsets.push_back(_data.size());
+        _data.resize(_data.size() + space);
+        return Builder<TLayout>(std::span(_data).last(space), type, flags);
+    }
+
+    inline size_t size () const { return _offsets.size(); }
+    inline bool empty () const { return _offsets.empty(); }
+
+    nlmsghdr & operator[] (size_t i) {
+        return *reinterpret_cast<nlmsghdr *>(_data.data() + _offsets[i]);
+    }
+
+    // Messages [first, first + count) as they lay in the buffer
+    std::span<uint8_t> messages (size_t first, size_t count) {
+        trim();
+        const size_t begin = _offsets[first];
+        const size_t end = first + count < _offsets.size()
+                               ? _offsets[first + count] : _data.size();
+        return std::span(_data).subspan(begin, end - begin);
+    }
+
+    void clear () {
+        _data.clear();
+        _offsets.clear();
+    }
+
+private:
+    // Give the unused space of the last message back
+    void trim () {
+        if (_offsets.size())
+            _data.resize(_offsets.back() +
+                         NLMSG_ALIGN((*this)[_offsets.size() - 1].nlmsg_len));
+    }
 
-    LinkRequest(const uint16_t type, const uint16_t flags) :
-        hdr{.nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg)),
-                      .nlmsg_type = type,
-                      .nlmsg_flags = flags,
-                      .nlmsg_seq = static_cast<uint32_t>(std::time(0))},
-        ifi{.ifi_family = AF_UNSPEC} {}
+private:
+    std::vector<uint8_t> _data;
+    std::vector<size_t> _offsets;
 };
 
 }
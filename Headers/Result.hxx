@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <variant>
+
+/* Minimal std::expected substitute until the project moves to C++23.
+ * The names follow std::expected so the switch would be mechanical */
+
+struct Error
+{
+    int code;               // errno value if known, 0 otherwise
+    std::string message;
+};
+
+template <class T>
+class Result
+{
+public:
+    Result (T value) : _data(std::in_place_index<0>, std::move(value)) {}
+    Result (Error error) : _data(std::in_place_index<1>, std::move(error)) {}
+
+    bool has_value () const { return _data.index() == 0; }
+    explicit operator bool () const { return has_value(); }
+
+    T & value () { return std::get<0>(_data); }
+    const T & value () const { return std::get<0>(_data); }
+    const Error & error () const { return std::get<1>(_data); }
+
+    T & operator* () { return value(); }
+    const T & operator* () const { return value(); }
+    T * operator-> () { return &value(); }
+    const T * operator-> () const { return &value(); }
+
+private:
+    std::variant<T, Error> _data;
+};
+
+template <>
+class Result<void>
+{
+public:
+    Result () = default;
+    Result (Error error) : _error(std::move(error)), _failed(true) {}
+
+    bool has_value () const { return ! _failed; }
+    explicit operator bool () const { return has_value(); }
+
+    const Error & error () const { return _error; }
+
+private:
+    Error _error {0, ""};
+    bool _failed = false;
+};
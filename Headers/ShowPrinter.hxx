@@ -0,0 +1,154 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Output.hxx"
+#include "Topology.hxx"
+
+enum class ShowFormat { Text, Json, Binary };
+
+/* Layout of 'show --binary'. Everything is in the host byte order and
+ * unaligned, names aren't null-terminated:
+ *
+ *   Header | RecordHeader BridgeRecord name (PortRecord name)... | ...
+ *
+ * Missing and NotBridge records hold only the name that was asked for.
+ * With several namespaces a Netns record holding the namespace name goes
+ * before the records of that namespace. Error records hold the message */
+
+namespace ShowBinary
+{
+    // "BRSH" read as little-endian
+    static constexpr uint32_t Magic = 0x48535242;
+    static constexpr uint16_t Version = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+    };
+
+    enum class RecordType : uint16_t {
+        Bridge = 1, Missing, NotBridge, Netns, Error
+    };
+
+    // Size counts the bytes following the record header
+    struct RecordHeader {
+        uint32_t size;
+        RecordType type;
+        uint16_t reserved;
+    };
+
+    struct BridgeRecord {
+        int32_t ifindex;
+        uint32_t ports;
+        uint8_t bridgeId [8];
+        uint8_t stpEnabled;
+        uint8_t operstate;
+        uint16_t nameLength;
+    };
+
+    struct PortRecord {
+        int32_t ifindex;
+        uint8_t operstate;
+        uint8_t reserved;
+        uint16_t nameLength;
+    };
+}
+
+
+/* Formats what 'show' found right from the topology into the output */
+class ShowPrinter
+{
+public:
+    static std::unique_ptr<ShowPrinter> create (ShowFormat format,
+                                                Output &out);
+
+    ShowPrinter (Output &out) : _out(out) {}
+    virtual ~ShowPrinter () = default;
+
+    // The bridge with its ports
+    virtual void bridge (const Topology &topology, const Link &br) = 0;
+    // Asked for a bridge that doesn't exist or isn't a bridge
+    virtual void missing (std::string_view name) = 0;
+    virtual void notBridge (std::string_view name) = 0;
+    // What follows belongs to the network namespace
+    virtual void netns (std::string_view name) = 0;
+    // Failure not related to a bridge, e.g. of the whole namespace
+    virtual void error (std::string_view what) = 0;
+    // Complete the output
+    virtual void finish () {}
+
+protected:
+    Output &_out;
+};
+
+
+class TextPrinter : public ShowPrinter
+{
+public:
+    using ShowPrinter::ShowPrinter;
+
+    virtual void bridge (const Topology &topology, const Link &br) override;
+    virtual void missing (std::string_view name) override;
+    virtual void notBridge (std::string_view name) override;
+    virtual void netns (std::string_view name) override;
+    virtual void error (std::string_view what) override;
+
+private:
+    bool _headerPrinted = false;
+    size_t _namespaces = 0;
+};
+
+
+class JsonPrinter : public ShowPrinter
+{
+public:
+    using ShowPrinter::ShowPrinter;
+
+    virtual void bridge (const Topology &topology, const Link &br) override;
+    virtual void missing (std::string_view name) override;
+    virtual void notBridge (std::string_view name) override;
+    virtual void netns (std::string_view name) override;
+    virtual void error (std::string_view what) override;
+    virtual void finish () override;
+
+private:
+    struct Error {
+        std::string netns;
+        std::string name;
+        std::string what;
+    };
+
+private:
+    void begin ();
+    void quoted (std::string_view str);
+    // ,"netns":"..." if the namespace is given
+    void netnsField (std::string_view netns);
+
+private:
+    bool _begun = false;
+    size_t _bridges = 0;
+    std::string _netns;
+    // Printed after the bridges
+    std::vector<Error> _errors;
+};
+
+
+class BinaryPrinter : public ShowPrinter
+{
+public:
+    BinaryPrinter (Output &out);
+
+    virtual void bridge (const Topology &topology, const Link &br) override;
+    virtual void missing (std::string_view name) override;
+    virtual void notBridge (std::string_view name) override;
+    virtual void netns (std::string_view name) override;
+    virtual void error (std::string_view what) override;
+
+private:
+    void nameRecord (ShowBinary::RecordType type, std::string_view name);
+};
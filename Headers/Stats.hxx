@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+
+#include "Output.hxx"
+
+/* Phase timings and counters of the run. They are global since the
+ * transports, the parser and the allocator know nothing of each other, and
+ * atomic since the pipeline receiver and the namespace workers add to them
+ * too. Nothing is timed or counted until enable() is called, so the points
+ * instrumented cost a load of the flag otherwise.
+ *
+ * Phases are timed with the monotonic clock where they happen. With
+ * -pipeline receiving overlaps parsing, so the phases may sum to more than
+ * the wall time */
+
+class Stats
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    enum class Phase : uint8_t {
+        SocketSetup,    // socket options, bind() and checks
+        Send,           // sendmsg()
+        ReceiveWait,    // peek and recvmsg() or reading sysfs by -fb
+        Parse,          // going through the replies and their attributes
+        Topology,       // storing the links parsed
+        Format,         // formatting and writing the output
+        Count
+    };
+
+    enum class Counter : uint8_t {
+        Syscalls,       // of the netlink sockets
+        BytesSent,
+        BytesReceived,
+        Messages,       // answering the requests
+        Attributes,     // parsed, nested ones included
+        DumpRestarts,   // dumps redone on NLM_F_DUMP_INTR
+        Allocations,    // every form of operator new, counted by brctl
+        AllocatedBytes,
+        Count
+    };
+
+    static constexpr size_t Phases = static_cast<size_t>(Phase::Count);
+    static constexpr size_t Counters = static_cast<size_t>(Counter::Count);
+
+    // Everything taken so far, e.g. for programs using the library
+    struct Snapshot {
+        uint64_t wallNanoseconds;
+        std::array<uint64_t, Phases> nanoseconds;
+        std::array<uint64_t, Phases> calls;
+        std::array<uint64_t, Counters> counters;
+    };
+
+    /* Adds the time from construction to destruction to the phase. A timer
+     * of the phase running already on the thread takes that time anyway, so
+     * the nested one does nothing */
+    class Timer
+    {
+    public:
+        explicit Timer (Phase phase) : _phase(phase) {
+            bool &running = _running[static_cast<size_t>(phase)];
+            if (enabled() && ! running) {
+                running = true;
+                _start = Clock::now();
+            }
+        }
+        ~Timer () {
+            if (_start != Clock::time_point()) {
+                Stats::time(_phase, Clock::now() - _start);
+                _running[static_cast<size_t>(_phase)] = false;
+            }
+        }
+
+        Timer (const Timer &) = delete;
+        Timer & operator= (const Timer &) = delete;
+
+    private:
+        Phase _phase;
+        Clock::time_point _start {};
+    };
+
+public:
+    // Start counting from zero
+    static void enable ();
+    static inline bool enabled () {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    static inline void add (Counter counter, uint64_t value = 1) {
+        if (enabled())
+            _counters[static_cast<size_t>(counter)].fetch_add(
+                value, std::memory_order_relaxed);
+    }
+
+    static Snapshot snapshot ();
+    // One line of JSON with the phases in nanoseconds and the counters
+    static void print (Output &out);
+
+private:
+    static void time (Phase phase, Clock::duration duration);
+
+private:
+    static inline std::atomic<bool> _enabled = false;
+    static inline thread_local std::array<bool, Phases> _running {};
+    static inline Clock::time_point _enabledAt;
+    static inline std::array<std::atomic<uint64_t>, Phases> _nanoseconds {};
+    static inline std::array<std::atomic<uint64_t>, Phases> _calls {};
+    static inline std::array<std::atomic<uint64_t>, Counters> _counters {};
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cinttypes>
+
+#include "Device.hxx"
+#include "Output.hxx"
+
+/* Spanning tree state of bridges and their ports the way the kernel gives
+ * it in IFLA_BR_* and IFLA_BRPORT_* attributes. Times and timers are kept
+ * in hundredths of a second */
+
+struct BridgeStp
+{
+    BridgeId rootId {};
+    uint16_t rootPort = 0;
+    uint32_t rootPathCost = 0;
+
+    uint32_t maxAge = 0;
+    uint32_t helloTime = 0;
+    uint32_t forwardDelay = 0;
+    uint32_t ageingTime = 0;
+
+    uint64_t helloTimer = 0;
+    uint64_t tcnTimer = 0;
+    uint64_t topologyChangeTimer = 0;
+    uint64_t gcTimer = 0;
+
+    bool topologyChange = false;
+    bool topologyChangeDetected = false;
+};
+
+// Mirrors BR_STATE_* values
+enum class PortState : uint8_t {
+    Disabled, Listening, Learning, Forwarding, Blocking
+};
+
+struct PortStp
+{
+    PortState state = PortState::Disabled;
+    uint16_t priority = 0;
+    uint32_t cost = 0;
+    uint16_t id = 0;
+    uint16_t number = 0;
+
+    BridgeId designatedRoot {};
+    BridgeId designatedBridge {};
+    uint16_t designatedPort = 0;
+    uint32_t designatedCost = 0;
+
+    uint64_t messageAgeTimer = 0;
+    uint64_t forwardDelayTimer = 0;
+    uint64_t holdTimer = 0;
+
+    // IFLA_BRPORT_* flags which are set
+    bool configPending = false;
+    bool topologyChangeAck = false;
+    bool hairpin = false;
+    bool bpduGuard = false;
+    bool rootBlock = false;
+    bool fastLeave = false;
+    bool learning = false;
+    bool flood = false;
+};
+
+// The report of 'showstp': a block for the bridge and one for every port
+void printBridgeStp (Output &out, const Link &br, const BridgeStp &stp);
+void printPortStp (Output &out, const Link &port, const PortStp &stp);
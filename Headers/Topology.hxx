@@ -0,0 +1,50 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Device.hxx"
+
+/* Compact store of links. The records lay in a contiguous array at the
+ * position of their ifindex and the names are found through a single hash
+ * index. Ports of every bridge are kept as a span of one array sorted by
+ * master so building and querying stay linear in the number of links.
+ * Names must outlive the topology: they are expected to be in an Arena */
+
+class Topology
+{
+public:
+    void clear ();
+
+    // Add the link or replace the one with the same ifindex or name
+    void insert (const Link &link);
+    void erase (int index);
+    void setMaster (int index, uint32_t master);
+
+    const Link * find (int index) const;
+    const Link * find (std::string_view name) const;
+
+    // ifindexes of the bridge ports in ascending order
+    std::span<const int> ports (int bridge) const;
+    // ifindexes of all the bridges sorted by name
+    std::vector<int> bridges () const;
+
+    inline size_t size () const { return _names.size(); }
+    // All the slots, the unused ones have index 0
+    inline std::span<const Link> links () const { return _links; }
+
+private:
+    void buildPorts () const;
+
+private:
+    std::vector<Link> _links;   // slot == ifindex, unused slots have index 0
+    std::unordered_map<std::string_view, int> _names;
+
+    // Ports grouped by master: ports of bridge N are in
+    // [_portsBegin[N], _portsBegin[N + 1]). Rebuilt lazily after changes
+    mutable std::vector<int> _ports;
+    mutable std::vector<uint32_t> _portsBegin;
+    mutable bool _portsValid = false;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cinttypes>
+#include <span>
+#include <stdexcept>
+
+/* The way the netlink datagrams go to the kernel and back. NetlinkSession
+ * works with the live socket, a recorder wrapping it or a replayer of the
+ * capture file in the same way */
+
+class Transport
+{
+public:
+    // Thrown by receive() if the kernel dropped messages for the socket
+    struct Overrun : public std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+public:
+    virtual ~Transport () = default;
+
+    // Send a bunch of messages at once
+    virtual void send (std::span<iovec> messages) = 0;
+
+    // Wait for the next datagram and tell its size without taking it
+    virtual size_t peek () = 0;
+
+    /* Receive the next datagram. It's usually put into the buffer but the
+     * returned span may point to the transport's own memory which stays
+     * valid until the transport is destroyed */
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) = 0;
+
+    // Join the multicast group, e.g. RTNLGRP_LINK
+    virtual void subscribe (unsigned group) = 0;
+
+    // Address the replies are sent to
+    virtual uint32_t portId () const = 0;
+
+    // Descriptor to poll() for datagrams, -1 if there's none
+    virtual int fd () const { return -1; }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cinttypes>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "Output.hxx"
+
+/* VLANs of a bridge port kept as intervals of ids sharing the flags, the
+ * way the kernel reports them with RTEXT_FILTER_BRVLAN_COMPRESSED and takes
+ * them with range begin/end entries. A trunk of every VLAN is one range */
+
+struct VlanRange
+{
+    uint16_t first;
+    uint16_t last;
+    // BRIDGE_VLAN_INFO_PVID and BRIDGE_VLAN_INFO_UNTAGGED
+    uint16_t flags;
+};
+
+// Valid ids are 1-4094
+static constexpr uint16_t MaxVlanId = 4094;
+
+/* Parse "1-100,200,300-400" into ranges sorted by id with the overlapping
+ * and adjacent ones merged. Throws on anything else */
+std::vector<VlanRange> parseVlanRanges (std::string_view text,
+                                        uint16_t flags = 0);
+
+// Rows of 'vlan show' for one device, a range per row
+void printVlans (Output &out, std::string_view device,
+                 std::span<const VlanRange> vlans);
@@ -3,50 +3,132 @@
 #include <string>
 #include <linux/netlink.h>
 #include <functional>
+#include <memory>
+#include <span>
 
 #include "Application.hxx"
-#include "Socket.hxx"
+#include "Arena.hxx"
+#include "KernelTransport.hxx"
+#include "NetlinkSession.hxx"
 #include "Request.hxx"
+#include "Stats.hxx"
 
 
-// Returns a pointer to the free space AFTER the msg
-constexpr rtattr * NLMSG_TAIL (nlmsghdr *msg) {
-    return reinterpret_cast<rtattr *>(reinterpret_cast<size_t>(msg) +
-                                      NLMSG_ALIGN(msg->nlmsg_len));
-}
-
-// Calculates size for the given attribute assuming that everything behind it
-// are nested attributes.
-constexpr size_t NLMSG_NESTED_RTA_SIZE (nlmsghdr *msg, rtattr *attr) {
-    return reinterpret_cast<size_t>(NLMSG_TAIL(msg)) -
-           reinterpret_cast<size_t>(attr);
-}
-
-// Auxiliary class that helps to create empty attributes
-struct EmptyAttr {};
-
 //
 enum class ErrorCode { Success, DumpInconsistent };
 
+// Failure carrying errno so the callers may tell one from another
+struct NetlinkError : public std::runtime_error
+{
+    int code;
+
+    NetlinkError (int code, const std::string &what) :
+        std::runtime_error(what), code(code) {}
+};
+
 
 /* The class taking on all dirty work of Netlink communication */
 class _NetlinkImpl : public ApplicationData
 {
+public:
+    // Socket buffer sizes of the sessions opened later
+    void setSocketBuffers (int sndBufSize, int rcvBufSize);
+
+    // Receive dumps on a separate thread while parsing them
+    void setPipelined (bool pipelined) { _pipelined = pipelined; }
+
+    // Write the conversation with the kernel to the capture file
+    void record (const std::string &path);
+    // Take the replies from the capture file instead of the kernel
+    void replay (const std::string &path);
+
+protected:
     using ErrCallback = std::function<void(nlmsgerr *)>;
     using MsgCallback = std::function<void(nlmsghdr *)>;
-    using AttrCallback = std::function<void(unsigned short,
-                                            const rtattr * const)>;
 
 protected:
-    ErrorCode talkWithKernel(Message::LinkRequest &rq,
+    // Replies are received into keep if given so they outlive the call
+    ErrorCode talkWithKernel(nlmsghdr &rq,
                              ErrCallback errHandle = nullptr,
-                             MsgCallback msgHandle = nullptr);
+                             MsgCallback msgHandle = nullptr,
+                             Arena *keep = nullptr);
+    // Every request of the batch gets the ACK handler at its position
+    void talkWithKernel(Message::Batch &batch,
+                        std::span<const ErrCallback> errHandles);
+
+    /* The same as talkWithKernel() but the replies are received on another
+     * thread meanwhile. The buffers are reused so the messages are valid
+     * only until msgHandle returns */
+    ErrorCode pipelineWithKernel (nlmsghdr &rq,
+                                  ErrCallback errHandle,
+                                  MsgCallback msgHandle);
+    inline bool pipelined () const { return _pipelined; }
+    inline const KernelTransport::Options & socketOptions () const {
+        return _socketOptions;
+    }
+    // Talking to a capture file rather than to the kernel only
+    inline bool capturing () const {
+        return _captureMode != CaptureMode::None;
+    }
 
-    std::string_view getOperstate (const rtattr * const attr) const;
-    std::string getBridgeId (const rtattr * const attr) const;
+    /* Pass the messages of one received datagram answering seq to the
+     * handlers. Returns true when the reply is complete */
+    bool handleReply (std::span<uint8_t> data, uint32_t portId, uint32_t seq,
+                      const ErrCallback &errHandle,
+                      const MsgCallback &msgHandle,
+                      ErrorCode &errorCode);
+    // Check if the datagram holds the last message of the reply
+    static bool isReplyEnd (std::span<const uint8_t> data,
+                            uint32_t portId, uint32_t seq);
+
+    // The session is opened on the first request and kept until destruction
+    NetlinkSession & session ();
+    // Transport of the session, e.g. the kernel socket or a capture file
+    virtual std::unique_ptr<Transport> openTransport ();
+    // Separate session subscribed to link notifications
+    NetlinkSession & events ();
+
+    Operstate getOperstate (const rtattr * const attr) const;
+    BridgeId getBridgeId (const rtattr * const attr) const;
+
+    /* Fill the table indexed by attribute type with the attributes of the
+     * message or of the nested attribute. Missed types are left untouched,
+     * types beyond the table are skipped */
+    template <class TFamilyHdr = ifinfomsg, size_t N>
+    void parseAttrs (const nlmsghdr *const hdr, const rtattr *(&tb)[N]) const
+    {
+        const rtattr *attr = reinterpret_cast<const rtattr *>(
+            reinterpret_cast<const uint8_t *>(NLMSG_DATA(hdr)) +
+            NLMSG_ALIGN(sizeof(TFamilyHdr)));
+        const int size = hdr->nlmsg_len - NLMSG_LENGTH(sizeof(TFamilyHdr));
+        attributeParser(attr, size, tableFiller(tb));
+    }
+
+    template <size_t N>
+    void parseNestedAttrs (const rtattr *const parent,
+                           const rtattr *(&tb)[N]) const
+    {
+        const rtattr *child = reinterpret_cast<const rtattr *>(
+            RTA_DATA(parent));
+        attributeParser(child, RTA_PAYLOAD(parent), tableFiller(tb));
+    }
 
-    void parseAttrs(const nlmsghdr *const msg, AttrCallback handle);
-    void parseNestedAttrs(const rtattr *const parent, AttrCallback handle);
+    // Call visit(type, attr) for every attribute in the sequence
+    template <class Visitor>
+    void attributeParser (const rtattr * attr, int size, Visitor &&visit) const
+    {
+        size_t count = 0;
+        while (RTA_OK(attr, size)) {
+            visit(static_cast<unsigned short>(attr->rta_type & ~NLA_F_NESTED),
+                  attr);
+            attr = RTA_NEXT(attr, size);
+            ++count;
+        }
+        Stats::add(Stats::Counter::Attributes, count);
+        if (size)
+            throw std::runtime_error(
+                std::format("{} bytes left after attribute parse", size));
+    }
 
 
     template <class T>
@@ -65,6 +147,13 @@ protected:
         else if constexpr (std::is_same_v<T, unsigned int>)
             return *reinterpret_cast<unsigned int *>RTA_DATA(attr);
 
+        // 64-bit values may be only 4-byte aligned
+        else if constexpr (std::is_same_v<T, uint64_t>) {
+            uint64_t value;
+            std::memcpy(&value, RTA_DATA(attr), sizeof(value));
+            return value;
+        }
+
         else if constexpr (std::is_same_v<T, ifla_bridge_id*>)
             return reinterpret_cast<ifla_bridge_id *>(RTA_DATA(attr));
 
@@ -72,48 +161,25 @@ protected:
             static_assert(false, "Don't know how to convert");
     }
 
-    template <class T, class TMessage>
-    rtattr * addAttr (nlmsghdr * msg, const uint16_t &type,
-                      const T &value = T())
+private:
+    template <size_t N>
+    static auto tableFiller (const rtattr *(&tb)[N])
     {
-        rtattr * attr = NLMSG_TAIL(msg);
-        int size;
-
-        auto add = [&](){
-            // Check if attribute fit into the message
-            if (NLMSG_ALIGN(msg->nlmsg_len) + RTA_ALIGN(size) > sizeof(TMessage))
-                throw std::runtime_error(
-                    std::format("Attribute {} won't fit into message", type));
-
-            attr->rta_type = type;
-            attr->rta_len = size;
+        return [&tb](unsigned short type, const rtattr *attr) {
+            if (type < N)
+                tb[type] = attr;
         };
-
-        if constexpr (std::is_same_v<T, std::string>) {
-            size = RTA_LENGTH(value.size() + 1);
-            add();
-            std::memcpy(RTA_DATA(attr), value.c_str(), value.size() + 1);
-        }
-        else if constexpr (std::is_integral_v<T>) {
-            size = RTA_LENGTH(sizeof(T));
-            add();
-            std::memcpy(RTA_DATA(attr), &value, sizeof(value));
-        }
-        else if constexpr (std::is_empty_v<T>) {
-            size = RTA_LENGTH(0);
-            add();
-        }
-        else
-            static_assert(false, "Don't know how to convert");
-
-        msg->nlmsg_len = NLMSG_ALIGN(msg->nlmsg_len) + RTA_ALIGN(size);
-        return attr;
     }
 
 private:
-    void setOptsMakeChecks(const int &fd,
-                           void * sndBuf, const size_t &sndBufSize,
-                           void * rcvBuf, const size_t &rcvBufSize,
-                           sockaddr_nl *addr, const size_t &addrSize);
-    void attributeParser (const rtattr * attr, int size, AttrCallback handle);
+    enum class CaptureMode { None, Record, Replay };
+
+    KernelTransport::Options _socketOptions;
+    bool _pipelined = false;
+
+    CaptureMode _captureMode = CaptureMode::None;
+    std::string _capturePath;
+
+    std::unique_ptr<NetlinkSession> _session;
+    std::unique_ptr<NetlinkSession> _events;
 };
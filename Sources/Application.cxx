@@ -1,6 +1,11 @@
 #include "Application.hxx"
 
+#include <linux/if_bridge.h>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <iterator>
+#include <vector>
 #include <format>
 
 using namespace std;
@@ -9,18 +14,44 @@ static struct __Helper {
     static constexpr string_view helpFmt = "\t{: <10}{: <20}{}";
     static constexpr string_view incorrectNA =
         "Incorrect number of arguments for command";
-    static constexpr unsigned int CommandsNumber = 5;
+    static constexpr unsigned int CommandsNumber = 11;
 
     struct Cmd {
         string_view command;
         string_view args;
         string_view help;
     } commands [CommandsNumber] = {
-        {"show", "[<bridge>]", "show a list of bridges"},
+        {"show", "[<opts>] [<bridge>]", "show a list of bridges"},
         {"addbr", "<bridge>", "add bridge"},
         {"delbr", "<bridge>", "delete bridge"},
         {"addif", "<bridge> <device>", "add interface to bridge"},
-        {"delif", "<bridge> <device>", "delete interface from bridge"}
+        {"delif", "<bridge> <device>", "delete interface from bridge"},
+        {"monitor", "", "print bridge and port changes as they happen"},
+        {"stp", "<bridge> {on|off}", "turn stp on/off"},
+        {"showstp", "[<bridge>]", "show bridge stp info"},
+        {"showmacs", "<bridge>", "show a list of mac addrs"},
+        {"vlan", "<cmd> ...", "show or change vlans, see below"},
+        {"apply", "[--prune] <file>", "make bridges as the file describes"}
+    };
+
+    static constexpr unsigned int ShowOptionsNumber = 4;
+
+    struct Opt {
+        string_view option;
+        string_view help;
+    } showOptions [ShowOptionsNumber] = {
+        {"--unsorted", "print bridges as soon as their ports are known"},
+        {"--json", "print JSON"},
+        {"--binary", "print length-prefixed binary records"},
+        {"--all-netns", "show bridges of every namespace in /run/netns"}
+    };
+
+    static constexpr unsigned int VlanCommandsNumber = 3;
+
+    Opt vlanCommands [VlanCommandsNumber] = {
+        {"show [<dev>]", "show vlans of bridges and ports"},
+        {"add <dev> <vids> [pvid] [untagged]", "add vlans, e.g. 1-100,200"},
+        {"del <dev> <vids>", "delete vlans"}
     };
 
     const Cmd & getCommand(string_view cmd) const {
@@ -55,12 +86,89 @@ void Application::PrintHelp()
          << "commands:" << endl;
     for (__Helper::Cmd &cmd : span(helper.commands))
         cout << helper.getHelp(cmd) << endl;
+    cout << "show options:" << endl;
+    for (__Helper::Opt &opt : span(helper.showOptions))
+        cout << format("\t{: <30}{}", opt.option, opt.help) << endl;
+    cout << "vlan commands:" << endl;
+    for (__Helper::Opt &opt : span(helper.vlanCommands))
+        cout << format("\t{: <40}{}", opt.option, opt.help) << endl;
 }
 
 void Application::run(span<const string> args)
 {
-    getDevicesAndBridges();
+    // Only show needs the topology, the rest look up what they need
+    if (args.front() == "show") {
+        auto bridges = parseShowOptions(args.last(args.size() - 1));
+        getBridges(bridges);
+        show(bridges);
+    }
+    else
+        dispatch(args);
+}
+
+span<const string> Application::parseShowOptions(span<const string> args)
+{
+    _showOptions = ShowOptions();
 
+    while (args.size() && args.front().starts_with("--")) {
+        if (args.front() == "--unsorted")
+            _showOptions.unsorted = true;
+        else if (args.front() == "--json")
+            _showOptions.format = ShowFormat::Json;
+        else if (args.front() == "--binary")
+            _showOptions.format = ShowFormat::Binary;
+        else if (args.front() == "--all-netns")
+            _showOptions.allNetns = true;
+        else
+            throw runtime_error(format("Unknown option {} of show",
+                                       args.front()));
+        args = args.last(args.size() - 1);
+    }
+    return args;
+}
+
+/* Batch file contains a command per line in the same form as they are given
+ * in the command line, e.g. "addif br0 eth0". Empty lines and lines starting
+ * with '#' are skipped. Implementation may take the topology only once for
+ * the whole batch in beginBatch() */
+
+void Application::runBatch(istream &input)
+{
+    vector<pair<size_t, vector<string>>> commands;
+    string line;
+
+    for (size_t lineNo = 1; getline(input, line); ++lineNo) {
+        istringstream words (line);
+        vector<string> args {istream_iterator<string>(words),
+                             istream_iterator<string>()};
+        if (args.size() && args.front().front() != '#')
+            commands.push_back({lineNo, move(args)});
+    }
+
+    beginBatch();
+
+    for (const auto &[lineNo, args] : commands) {
+        try {
+            if (args.front() == "show" || args.front() == "showstp" ||
+                args.front() == "showmacs" || args.front() == "monitor" ||
+                args.front() == "apply")
+                throw runtime_error(format("{} is not allowed in batch",
+                                           args.front()));
+            if (args.front() == "vlan" && args.size() > 1 &&
+                args[1] == "show")
+                throw runtime_error("vlan show is not allowed in batch");
+            helper.getCommand(args.front());
+            dispatch(args);
+        } catch (exception &e) {
+            cout << format("line {}: {}", lineNo, e.what()) << endl;
+        }
+    }
+
+    commitBatch();
+}
+
+void Application::dispatch(span<const string> args)
+{
     const auto cmd = args.front();
     bool invalidArgumentsNumber = false;
 
@@ -91,6 +199,42 @@ void Application::run(span<const string> args)
         else
             invalidArgumentsNumber = true;
     }
+    else if (cmd == "monitor") {
+        monitor();
+    }
+    else if (cmd == "stp") {
+        if (args.size() > 2 &&
+            (args[2] == "on" || args[2] == "yes" || args[2] == "1"))
+            stp(args[1], true);
+        else if (args.size() > 2 &&
+                 (args[2] == "off" || args[2] == "no" || args[2] == "0"))
+            stp(args[1], false);
+        else
+            invalidArgumentsNumber = true;
+    }
+    else if (cmd == "showstp") {
+        showstp(args.last(args.size() - 1));
+    }
+    else if (cmd == "showmacs") {
+        if (args.size() > 1)
+            showmacs(args[1]);
+        else
+            invalidArgumentsNumber = true;
+    }
+    else if (cmd == "vlan") {
+        if (args.size() > 1 && args[1] == "show")
+            showvlans(args.last(args.size() - 2));
+        else if (args.size() > 3 && (args[1] == "add" || args[1] == "del"))
+            changeVlans(args.last(args.size() - 1));
+        else
+            invalidArgumentsNumber = true;
+    }
+    else if (cmd == "apply") {
+        if (args.size() > 1)
+            applyFile(args.last(args.size() - 1));
+        else
+            invalidArgumentsNumber = true;
+    }
     else {
         if (args.size())
             cout << format("never heard of command [{}]", cmd) << endl;
@@ -103,12 +247,51 @@ void Application::run(span<const string> args)
     }
 }
 
-bool ApplicationData::isMaster (const std::string &dev,
-                                const std::string &br) const
+void Application::changeVlans(span<const string> args)
 {
-    auto range = _relations.equal_range(br);
-    for (auto it = range.first; it != range.second; ++it)
-        if (it->second == dev)
-            return true;
-    return false;
+    const bool add = args[0] == "add";
+    uint16_t flags = 0;
+
+    for (const string &option : args.last(args.size() - 3)) {
+        if (add && option == "pvid")
+            flags |= BRIDGE_VLAN_INFO_PVID;
+        else if (add && option == "untagged")
+            flags |= BRIDGE_VLAN_INFO_UNTAGGED;
+        else
+            throw runtime_error(format("Unknown option {} of vlan {}",
+                                       option, args[0]));
+    }
+
+    const vector<VlanRange> vlans = parseVlanRanges(args[2], flags);
+    if ((flags & BRIDGE_VLAN_INFO_PVID) &&
+        (vlans.size() > 1 || vlans.front().first != vlans.front().last))
+        throw runtime_error("pvid takes a single vlan");
+
+    if (add)
+        addvlans(args[1], vlans);
+    else
+        delvlans(args[1], vlans);
+}
+
+/* The whole file is read before anything is changed, so a mistake in it
+ * leaves the bridges as they are */
+void Application::applyFile(span<const string> args)
+{
+    const bool prune = args.front() == "--prune";
+    if (prune)
+        args = args.last(args.size() - 1);
+    if (args.size() != 1)
+        throw runtime_error(format("Usage: {}",
+                                   helper.getCorrectUsage("apply")));
+
+    vector<DesiredBridge> bridges;
+    if (args.front() == "-")
+        bridges = parseDesiredTopology(cin);
+    else {
+        ifstream file (args.front());
+        if (! file)
+            throw runtime_error(format("Failed to open {}", args.front()));
+        bridges = parseDesiredTopology(file);
+    }
+    apply(bridges, prune);
 }
@@ -0,0 +1,97 @@
+#include "Brctl.hxx"
+#include "Netlink.hxx"
+
+namespace brctl {
+
+/* Netlink with access to the topology it takes */
+class Client::Impl : public Netlink
+{
+public:
+    std::vector<BridgeInfo> snapshot (std::span<const std::string> bridges)
+    {
+        // Nothing refers to the previous topology so drop it completely
+        _topology.clear();
+        _arena.clear();
+        getBridges(bridges);
+
+        std::vector<BridgeInfo> result;
+
+        auto add = [&](const Link &br) {
+            BridgeInfo &info = result.emplace_back(
+                BridgeInfo{std::string(br.name), br.index, br.bridge_id,
+                           br.stp_state, br.operstate, {}});
+
+            for (int index : _topology.ports(br.index)) {
+                const Link *port = _topology.find(index);
+                info.ports.push_back(
+                    {std::string(port->name), port->index, port->operstate});
+            }
+        };
+
+        if (bridges.size())
+            for (const auto &name : bridges) {
+                const Link *br = _topology.find(name);
+                if (! br || ! br->isBridge())
+                    throw NetlinkError(ENODEV,
+                        std::format("bridge {} does not exist!", name));
+                add(*br);
+            }
+        else
+            for (int br : _topology.bridges())
+                add(*_topology.find(br));
+
+        return result;
+    }
+};
+
+// Turn whatever has been thrown into Error
+template <class F>
+static auto guard (F &&f) -> Result<decltype(f())>
+{
+    try {
+        if constexpr (std::is_void_v<decltype(f())>) {
+            f();
+            return {};
+        }
+        else
+            return f();
+    } catch (NetlinkError &e) {
+        return Error{e.code, e.what()};
+    } catch (std::exception &e) {
+        return Error{0, e.what()};
+    }
+}
+
+Client::Client () : _impl(std::make_unique<Impl>()) {}
+
+Client::~Client () = default;
+
+Result<std::vector<BridgeInfo>> Client::show (
+    std::span<const std::string> bridges)
+{
+    return guard([&] { return _impl->snapshot(bridges); });
+}
+
+Result<void> Client::addbr (const std::string &bridge)
+{
+    return guard([&] { _impl->addbr(bridge); });
+}
+
+Result<void> Client::delbr (const std::string &bridge)
+{
+    return guard([&] { _impl->delbr(bridge); });
+}
+
+Result<void> Client::addif (const std::string &bridge,
+                            const std::string &device)
+{
+    return guard([&] { _impl->addif(bridge, device); });
+}
+
+Result<void> Client::delif (const std::string &bridge,
+                            const std::string &device)
+{
+    return guard([&] { _impl->delif(bridge, device); });
+}
+
+}
@@ -0,0 +1,189 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+#include "Capture.hxx"
+
+using namespace Capture;
+
+Recorder::Recorder (std::unique_ptr<Transport> transport,
+                    const std::string &path) :
+    _transport(std::move(transport)),
+    _file(path, std::ios::binary | std::ios::trunc)
+{
+    if (! _file.good())
+        throw std::runtime_error(std::format("Failed to open {}", path));
+
+    const FileHeader header {.magic = Magic, .version = Version,
+                             .portId = _transport->portId()};
+    _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void Recorder::send (std::span<iovec> messages)
+{
+    _transport->send(messages);
+    write(Direction::Sent, messages);
+}
+
+size_t Recorder::peek ()
+{
+    try {
+        return _transport->peek();
+    } catch (Overrun &) {
+        write(Direction::Overrun, {});
+        throw;
+    }
+}
+
+std::span<uint8_t> Recorder::receive (std::span<uint8_t> buffer)
+{
+    try {
+        std::span<uint8_t> data = _transport->receive(buffer);
+        const iovec iov {.iov_base = data.data(), .iov_len = data.size()};
+        write(Direction::Received, std::span(&iov, 1));
+        return data;
+    } catch (Overrun &) {
+        write(Direction::Overrun, {});
+        throw;
+    }
+}
+
+void Recorder::subscribe (unsigned group)
+{
+    _transport->subscribe(group);
+}
+
+uint32_t Recorder::portId () const
+{
+    return _transport->portId();
+}
+
+void Recorder::write (Direction direction, std::span<const iovec> datagram)
+{
+    RecordHeader header {.length = 0, .direction = direction};
+    for (const iovec &iov : datagram)
+        header.length += iov.iov_len;
+
+    _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const iovec &iov : datagram)
+        _file.write(static_cast<const char *>(iov.iov_base), iov.iov_len);
+
+    const char pad [NLMSG_ALIGNTO] = {};
+    _file.write(pad, NLMSG_ALIGN(header.length) - header.length);
+
+    if (! _file.good())
+        throw std::runtime_error("Failed to write the capture file");
+}
+
+
+Replayer::Replayer (const std::string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(std::format("Failed to open {}: {}",
+                                             path, std::strerror(errno)));
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+            static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        close(fd);
+        throw std::runtime_error(std::format("{} is not a capture file",
+                                             path));
+    }
+
+    // Private writable mapping lets the handlers take non-const messages
+    // while nothing is copied unless it's really written to
+    void *map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error(std::format("Failed to map {}: {}",
+                                             path, std::strerror(errno)));
+    _map = std::span(static_cast<uint8_t *>(map), st.st_size);
+
+    const FileHeader *header = reinterpret_cast<const FileHeader *>(
+        _map.data());
+    if (header->magic != Magic || header->version != Version) {
+        munmap(_map.data(), _map.size());
+        throw std::runtime_error(std::format("{} is not a capture file of "
+                                             "version {}", path, Version));
+    }
+    _portId = header->portId;
+    _offset = sizeof(FileHeader);
+}
+
+Replayer::~Replayer ()
+{
+    munmap(_map.data(), _map.size());
+}
+
+void Replayer::send (std::span<iovec> messages)
+{
+    std::span<uint8_t> recorded = next(Direction::Sent);
+    advance(recorded);
+
+    // Replies fit only the very same requests sent in the same order
+    size_t offset = 0;
+    bool same = true;
+    for (const iovec &iov : messages) {
+        same = same && offset + iov.iov_len <= recorded.size() &&
+               ! std::memcmp(recorded.data() + offset, iov.iov_base,
+                             iov.iov_len);
+        offset += iov.iov_len;
+    }
+    if (! same || offset != recorded.size()) {
+        const nlmsghdr *expected = reinterpret_cast<const nlmsghdr *>(
+            recorded.data());
+        throw std::runtime_error(
+            std::format("Replay diverged from the capture: the request "
+                        "differs from the recorded one (type {}, seq {})",
+                        expected->nlmsg_type, expected->nlmsg_seq));
+    }
+}
+
+size_t Replayer::peek ()
+{
+    return next(Direction::Received).size();
+}
+
+std::span<uint8_t> Replayer::receive (std::span<uint8_t>)
+{
+    std::span<uint8_t> datagram = next(Direction::Received);
+    advance(datagram);
+    return datagram;
+}
+
+std::span<uint8_t> Replayer::next (Direction expected)
+{
+    if (_offset + sizeof(RecordHeader) > _map.size())
+        throw std::runtime_error("Capture file has no more records");
+
+    const RecordHeader *header = reinterpret_cast<const RecordHeader *>(
+        _map.data() + _offset);
+    const size_t start = _offset + sizeof(RecordHeader);
+    if (start + header->length > _map.size())
+        throw std::runtime_error("Capture file is truncated");
+
+    if (header->direction == Direction::Overrun &&
+            expected == Direction::Received) {
+        _offset = start;
+        throw Overrun("Netlink receive queue overrun");
+    }
+    if (header->direction != expected)
+        throw std::runtime_error(
+            std::format("Replay diverged from the capture: expected {} "
+                        "record at offset {}",
+                        expected == Direction::Sent ? "sent" : "received",
+                        _offset));
+
+    return _map.subspan(start, header->length);
+}
+
+void Replayer::advance (std::span<uint8_t> record)
+{
+    _offset = record.data() - _map.data() + NLMSG_ALIGN(record.size());
+}
@@ -0,0 +1,80 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "Stats.hxx"
+
+/* The allocator of the brctl executable counts for -stats. It's not in the
+ * library so programs using it keep their own allocator. Every form of
+ * operator new goes through allocate(), the array forms call these by
+ * default. Everything is freed with free() whatever delete is called */
+
+static void * allocate (std::size_t size, std::size_t alignment)
+{
+    Stats::add(Stats::Counter::Allocations);
+    Stats::add(Stats::Counter::AllocatedBytes, size);
+
+    if (! size)
+        size = 1;
+    if (alignment <= alignof(std::max_align_t))
+        return std::malloc(size);
+    // aligned_alloc() takes multiples of the alignment only
+    return std::aligned_alloc(alignment,
+                              (size + alignment - 1) & ~(alignment - 1));
+}
+
+void * operator new (std::size_t size)
+{
+    if (void *memory = allocate(size, 0))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void * operator new (std::size_t size, std::align_val_t alignment)
+{
+    if (void *memory = allocate(size, static_cast<std::size_t>(alignment)))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void * operator new (std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size, 0);
+}
+
+void * operator new (std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete (void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete (void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete (void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete (void *memory, std::size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete (void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete (void *memory, std::align_val_t,
+                      const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
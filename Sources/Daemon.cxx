@@ -0,0 +1,300 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "Daemon.hxx"
+#include "Output.hxx"
+
+// Abstract names start with a null and aren't terminated
+static socklen_t socketAddress (sockaddr_un &address)
+{
+    address = {.sun_family = AF_UNIX};
+    std::memcpy(address.sun_path + 1, Daemon::SocketName.data(),
+                Daemon::SocketName.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + Daemon::SocketName.size();
+}
+
+static void writeAll (int fd, std::string_view data)
+{
+    while (! data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::format("Failed to write: {}",
+                                                 std::strerror(errno)));
+        }
+        data.remove_prefix(written);
+    }
+}
+
+/* Only show is answered from the topology. The changes are served too so
+ * they go over the same session, the rest take their own dumps or read
+ * the client's files and are run by the client */
+bool Daemon::serves (std::span<const std::string> args)
+{
+    if (args.empty())
+        return false;
+
+    const std::string &cmd = args.front();
+    if (cmd == "show")
+        // The topology is of the daemon's namespace only
+        return std::ranges::find(args, "--all-netns") == args.end();
+    if (cmd == "vlan")
+        return args.size() > 1 && (args[1] == "add" || args[1] == "del");
+    return cmd == "addbr" || cmd == "delbr" || cmd == "addif" ||
+           cmd == "delif" || cmd == "stp";
+}
+
+std::optional<int> Daemon::forward (std::span<const std::string> args)
+{
+    FileDescriptor sock (socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (! sock)
+        return std::nullopt;
+
+    sockaddr_un address;
+    const socklen_t length = socketAddress(address);
+    if (connect(sock.fd(), reinterpret_cast<sockaddr *>(&address),
+                length) < 0)
+        return std::nullopt;
+
+    /* Anyone may bind the abstract name, so only a daemon run by root or
+     * by ourselves is trusted with the command and the output */
+    ucred peer;
+    socklen_t peerLength = sizeof(peer);
+    if (getsockopt(sock.fd(), SOL_SOCKET, SO_PEERCRED, &peer,
+                   &peerLength) < 0 ||
+        (peer.uid != 0 && peer.uid != geteuid()))
+        return std::nullopt;
+
+    // The length of the words goes first
+    std::string request (sizeof(uint32_t), '\0');
+    for (const std::string &arg : args) {
+        request.append(arg);
+        request.push_back('\0');
+    }
+    const uint32_t size = request.size() - sizeof(uint32_t);
+    std::memcpy(request.data(), &size, sizeof(size));
+    writeAll(sock.fd(), request);
+
+    // The last byte is the status, so one is held back until the end
+    std::vector<char> buffer (Output::FlushSize);
+    size_t held = 0;
+    while (true) {
+        const ssize_t received = read(sock.fd(), buffer.data() + held,
+                                      buffer.size() - held);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::format("Lost the daemon: {}",
+                                                 std::strerror(errno)));
+        }
+        if (received == 0)
+            break;
+        const size_t size = held + received;
+        writeAll(STDOUT_FILENO, std::string_view(buffer.data(), size - 1));
+        buffer[0] = buffer[size - 1];
+        held = 1;
+    }
+
+    if (! held)
+        throw std::runtime_error("Lost the daemon: it closed the connection "
+                                 "without a status");
+    return static_cast<unsigned char>(buffer[0]);
+}
+
+Daemon::Daemon () :
+    _listener(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)),
+    _owner(geteuid())
+{
+    if (! _listener)
+        throw std::runtime_error(std::format("Failed to create socket: {}",
+                                             std::strerror(errno)));
+
+    sockaddr_un address;
+    const socklen_t length = socketAddress(address);
+    if (bind(_listener.fd(), reinterpret_cast<sockaddr *>(&address),
+             length) < 0) {
+        if (errno == EADDRINUSE)
+            throw std::runtime_error("The daemon is already running in this "
+                                     "network namespace");
+        throw std::runtime_error(std::format("Failed to bind socket: {}",
+                                             std::strerror(errno)));
+    }
+    if (listen(_listener.fd(), SOMAXCONN) < 0)
+        throw std::runtime_error(std::format("Failed to listen: {}",
+                                             std::strerror(errno)));
+
+    // A client going away in the middle of the output mustn't kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    _netlink.becomeResident();
+}
+
+/* Notifications are applied as they come, so they don't pile up in the
+ * socket while nobody asks. Clients are read and written without blocking,
+ * so a slow one holds nobody else up. Their commands are run one at a time
+ * as soon as they're received, after the notifications which came before */
+void Daemon::run ()
+{
+    std::vector<pollfd> fds;
+
+    while (true) {
+        const auto now = Clock::now();
+        std::erase_if(_clients, [now](const Client &client) {
+            return client.deadline <= now;
+        });
+
+        // Until the nearest deadline
+        int timeout = -1;
+        for (const Client &client : _clients) {
+            const int left = std::chrono::ceil<std::chrono::milliseconds>(
+                client.deadline - now).count();
+            timeout = timeout < 0 ? left : std::min(timeout, left);
+        }
+
+        fds.clear();
+        fds.push_back({.fd = _netlink.eventsFd(), .events = POLLIN});
+        // The rest wait in the backlog meanwhile
+        fds.push_back({.fd = _clients.size() < MaxClients ? _listener.fd()
+                                                          : -1,
+                       .events = POLLIN});
+        for (const Client &client : _clients)
+            fds.push_back({.fd = client.fd.fd(),
+                           .events = static_cast<short>(
+                               client.replying ? POLLOUT : POLLIN)});
+
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::format("Failed to poll: {}",
+                                                 std::strerror(errno)));
+        }
+
+        if (fds[0].revents)
+            _netlink.applyEvents();
+
+        // Served ones are dropped by the deadline above
+        for (size_t i = 0; i < _clients.size(); ++i)
+            if (fds[i + 2].revents && ! serve(_clients[i]))
+                _clients[i].deadline = Clock::time_point();
+
+        if (fds[1].revents & POLLIN) {
+            FileDescriptor client (accept4(_listener.fd(), nullptr, nullptr,
+                                           SOCK_NONBLOCK | SOCK_CLOEXEC));
+            if (client)
+                _clients.push_back(Client{
+                    .fd = std::move(client),
+                    .deadline = Clock::now() +
+                                std::chrono::milliseconds(ClientTimeout),
+                    .data = std::string(sizeof(uint32_t), '\0')});
+        }
+    }
+}
+
+bool Daemon::serve (Client &client)
+{
+    while (client.done < client.data.size()) {
+        const ssize_t done = client.replying
+            ? write(client.fd.fd(), client.data.data() + client.done,
+                    client.data.size() - client.done)
+            : read(client.fd.fd(), client.data.data() + client.done,
+                   client.data.size() - client.done);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done < 0)
+            return errno == EAGAIN;
+        // Gone before the request was whole
+        if (done == 0)
+            return false;
+        client.done += done;
+
+        // The words follow their length
+        if (! client.replying && client.done == sizeof(uint32_t) &&
+            client.data.size() == sizeof(uint32_t)) {
+            uint32_t size;
+            std::memcpy(&size, client.data.data(), sizeof(size));
+            if (size > MaxRequestSize)
+                return false;
+            client.data.resize(sizeof(uint32_t) + size);
+        }
+    }
+    if (client.replying)
+        return false;
+
+    // Every word is followed by a null
+    std::vector<std::string> args;
+    const std::string_view request =
+        std::string_view(client.data).substr(sizeof(uint32_t));
+    for (size_t begin = 0, end;
+         (end = request.find('\0', begin)) != request.npos; begin = end + 1)
+        args.emplace_back(request.substr(begin, end - begin));
+
+    client.data = execute(client.fd.fd(), args);
+    client.done = 0;
+    client.replying = true;
+    return serve(client);
+}
+
+std::string Daemon::execute (int client, std::span<const std::string> args)
+{
+    // Commands print to stdout, so it's a file in memory meanwhile
+    FileDescriptor output (memfd_create("brctl-reply", MFD_CLOEXEC));
+    if (! output)
+        return std::format("Failed to create the reply: {}\n\1",
+                           std::strerror(errno));
+
+    std::cout.flush();
+    FileDescriptor saved (fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0));
+    dup2(output.fd(), STDOUT_FILENO);
+
+    unsigned char status = 0;
+    try {
+        if (! serves(args))
+            throw std::runtime_error("The command isn't run by the daemon");
+        if (args.front() != "show" && ! mayChange(client))
+            throw std::runtime_error(std::format("{}: {}", args.front(),
+                                                 std::strerror(EPERM)));
+        _netlink.run(args);
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        status = 1;
+    }
+
+    std::cout.flush();
+    if (saved)
+        dup2(saved.fd(), STDOUT_FILENO);
+    else
+        close(STDOUT_FILENO);
+
+    std::string reply (lseek(output.fd(), 0, SEEK_END), '\0');
+    if (pread(output.fd(), reply.data(), reply.size(), 0) !=
+        static_cast<ssize_t>(reply.size()))
+        reply = std::format("Failed to read the reply: {}\n",
+                            std::strerror(errno));
+    reply.push_back(status);
+    return reply;
+}
+
+bool Daemon::mayChange (int client) const
+{
+    ucred peer;
+    socklen_t length = sizeof(peer);
+
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &length) < 0)
+        return false;
+    return peer.uid == 0 || peer.uid == _owner;
+}
@@ -0,0 +1,73 @@
+#include <format>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "DesiredTopology.hxx"
+
+namespace
+{
+    DesiredBridge parseBridge (const std::vector<std::string> &words)
+    {
+        if (words.front() != "bridge" || words.size() < 2)
+            throw std::runtime_error("expected bridge <name> "
+                                     "[stp on|off] [ports <dev>...]");
+
+        DesiredBridge bridge {.name = words[1]};
+        size_t i = 2;
+
+        if (i < words.size() && words[i] == "stp") {
+            if (i + 1 == words.size() ||
+                (words[i + 1] != "on" && words[i + 1] != "off"))
+                throw std::runtime_error("stp takes on or off");
+            bridge.stp = words[i + 1] == "on";
+            i += 2;
+        }
+
+        if (i < words.size()) {
+            if (words[i] != "ports")
+                throw std::runtime_error(
+                    std::format("unexpected {}", words[i]));
+            bridge.ports.assign(words.begin() + i + 1, words.end());
+        }
+        return bridge;
+    }
+}
+
+std::vector<DesiredBridge> parseDesiredTopology (std::istream &input)
+{
+    std::vector<DesiredBridge> bridges;
+    std::unordered_set<std::string> names;
+    std::string line;
+
+    for (size_t lineNo = 1; std::getline(input, line); ++lineNo) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream (line);
+        std::vector<std::string> words {
+            std::istream_iterator<std::string>(stream),
+            std::istream_iterator<std::string>()};
+        if (words.empty())
+            continue;
+
+        try {
+            DesiredBridge bridge = parseBridge(words);
+
+            // Bridges and ports share the names of devices
+            auto claim = [&names](const std::string &name) {
+                if (! names.insert(name).second)
+                    throw std::runtime_error(
+                        std::format("{} is given twice", name));
+            };
+            claim(bridge.name);
+            for (const std::string &port : bridge.ports)
+                claim(port);
+
+            bridges.push_back(std::move(bridge));
+        } catch (std::exception &e) {
+            throw std::runtime_error(
+                std::format("line {}: {}", lineNo, e.what()));
+        }
+    }
+    return bridges;
+}
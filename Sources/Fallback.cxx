@@ -1,105 +1,491 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <exception>
 #include <iostream>
-#include <fstream>
+#include <thread>
 
 #include "Fallback.hxx"
+#include "Output.hxx"
+#include "Stats.hxx"
 
 using namespace std;
-namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr const char *SysClassNet = "/sys/class/net";
+
+    // Interfaces taken by a thread at once
+    constexpr size_t ReadChunk = 64;
+
+    // Attributes are short, the longest one read is bridge_id
+    constexpr size_t AttributeSize = 64;
+
+    /* Read the attribute relative to the directory with a single read().
+     * Returns false if there is no such attribute */
+    bool readAttribute (int dirfd, const char *path,
+                        array<char, AttributeSize> &buffer,
+                        string_view &value)
+    {
+        FileDescriptor file (openat(dirfd, path, O_RDONLY | O_CLOEXEC));
+        if (! file) {
+            if (errno == ENOENT || errno == ENOTDIR)
+                return false;
+            throw runtime_error(format("Failed to open {}: {}",
+                                       path, strerror(errno)));
+        }
+
+        ssize_t length;
+        do
+            length = read(file.fd(), buffer.data(), buffer.size());
+        while (length < 0 && errno == EINTR);
+        if (length < 0)
+            throw runtime_error(format("Failed to read {}: {}",
+                                       path, strerror(errno)));
+
+        value = string_view(buffer.data(), length);
+        // strip string
+        while (value.size() && (value.back() == '\n' || value.back() == ' '))
+            value.remove_suffix(1);
+        return true;
+    }
+
+    // Names in the directory relative to dirfd except the dot entries
+    vector<string> listDirectory (int dirfd, const char *path)
+    {
+        const int fd = openat(dirfd, path,
+                              O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT || errno == ENOTDIR)
+                return {};
+            throw runtime_error(format("Failed to open {}: {}",
+                                       path, strerror(errno)));
+        }
+
+        // The descriptor belongs to the stream from now on
+        DIR *dir = fdopendir(fd);
+        if (! dir) {
+            close(fd);
+            throw runtime_error(format("Failed to list {}: {}",
+                                       path, strerror(errno)));
+        }
+
+        vector<string> names;
+        while (const dirent *entry = readdir(dir)) {
+            const string_view name = entry->d_name;
+            if (name != "." && name != "..")
+                names.emplace_back(name);
+        }
+        closedir(dir);
+        return names;
+    }
+}
 
 void Fallback::show (std::span<const std::string> bridges)
 {
-    cout << "Fallback::show() would be implemented sometime" << endl;
+    Output out;
+    auto printer = ShowPrinter::create(_showOptions.format, out);
+    Stats::Timer timer (Stats::Phase::Format);
+
+    // If some parameters to 'show' given
+    if (bridges.size()) {
+        for (const auto &iface : bridges) {
+            const Link *br = _topology.find(iface);
+            if (! br)
+                printer->missing(iface);
+            else if (! br->isBridge())
+                printer->notBridge(iface);
+            else
+                printer->bridge(_topology, *br);
+        }
+    }
+
+    // Print all bridges if 'show' is bare, by name or by ifindex
+    else if (_showOptions.unsorted) {
+        for (const Link &link : _topology.links())
+            if (link.index && link.isBridge())
+                printer->bridge(_topology, link);
+    }
+    else
+        for (int br : _topology.bridges())
+            printer->bridge(_topology, *_topology.find(br));
+
+    printer->finish();
+    out.flush();
 }
 
 void Fallback::addbr (const std::string &bridge)
 {
-    cout << "Fallback::addbr() would be implemented sometime" << endl;
+    if (const int error = bridgeIoctl(SIOCBRADDBR, bridge)) {
+        if (error == EEXIST)
+            throw runtime_error(format("device {} already exists; can't "
+                                       "create bridge with the same name",
+                                       bridge));
+        throw runtime_error(format("add bridge failed: {}",
+                                   strerror(error)));
+    }
 }
 
 void Fallback::delbr (const std::string &bridge)
 {
-    cout << "Fallback::delbr() would be implemented sometime" << endl;
+    // The name may be taken by another device afterwards
+    _indexes.erase(bridge);
+
+    if (const int error = bridgeIoctl(SIOCBRDELBR, bridge)) {
+        if (error == ENXIO)
+            throw runtime_error(format("bridge {} doesn't exist; can't "
+                                       "delete it", bridge));
+        if (error == EBUSY)
+            throw runtime_error(format("bridge {} is still up; can't "
+                                       "delete it", bridge));
+        throw runtime_error(format("can't delete bridge {}: {}",
+                                   bridge, strerror(error)));
+    }
 }
 
 void Fallback::addif (const std::string &bridge, const std::string &device)
 {
-    cout << "Fallback::addif() would be implemented sometime" << endl;
+    const int index = indexOf(device);
+    if (! index)
+        throw runtime_error(format("interface {} doest not exist!", device));
+
+    if (const int error = bridgeIoctl(SIOCBRADDIF, bridge, index)) {
+        // The ioctl isn't there for anything but a bridge
+        if (error == ENODEV || error == EOPNOTSUPP)
+            throw runtime_error(format("bridge {} does not exist!", bridge));
+        if (error == ELOOP)
+            throw runtime_error(format("device {} is a bridge device itself; "
+                                       "can't enslave a bridge device to a "
+                                       "bridge device", device));
+        if (error == EBUSY)
+            throw runtime_error(format("device {} is already a member of a "
+                                       "bridge; can't enslave it to bridge "
+                                       "{}", device, bridge));
+        throw runtime_error(format("can't add {} to bridge {}: {}",
+                                   device, bridge, strerror(error)));
+    }
 }
 
 void Fallback::delif (const std::string &bridge, const std::string &device)
 {
-    cout << "Fallback::delif() would be implemented sometime" << endl;
+    const int index = indexOf(device);
+    if (! index)
+        throw runtime_error(format("interface {} doest not exist!", device));
+
+    if (const int error = bridgeIoctl(SIOCBRDELIF, bridge, index)) {
+        if (error == ENODEV || error == EOPNOTSUPP)
+            throw runtime_error(format("bridge {} does not exist!", bridge));
+        if (error == EINVAL)
+            throw runtime_error(format("device {} is not a port of {}",
+                                       device, bridge));
+        throw runtime_error(format("can't delete {} from {}: {}",
+                                   device, bridge, strerror(error)));
+    }
+}
+
+/* As the original brctl does, through bridge/stp_state of sysfs */
+void Fallback::stp (const std::string &bridge, bool on)
+{
+    const string path = format("{}/bridge/stp_state", bridge);
+    FileDescriptor file (openat(sysfs(), path.c_str(), O_WRONLY | O_CLOEXEC));
+    if (! file)
+        throw runtime_error(format("bridge {} does not exist!", bridge));
+
+    if (write(file.fd(), on ? "1" : "0", 1) != 1)
+        throw runtime_error(format("can't set stp of {}: {}",
+                                   bridge, strerror(errno)));
+}
+
+void Fallback::monitor ()
+{
+    throw runtime_error("monitor needs netlink");
+}
+
+void Fallback::showstp (std::span<const std::string>)
+{
+    throw runtime_error("showstp needs netlink");
+}
+
+void Fallback::showmacs (const std::string &)
+{
+    throw runtime_error("showmacs needs netlink");
+}
+
+void Fallback::showvlans (std::span<const std::string>)
+{
+    throw runtime_error("vlan show needs netlink");
+}
+
+void Fallback::addvlans (const std::string &, std::span<const VlanRange>)
+{
+    throw runtime_error("vlan add needs netlink");
+}
+
+void Fallback::delvlans (const std::string &, std::span<const VlanRange>)
+{
+    throw runtime_error("vlan del needs netlink");
+}
+
+void Fallback::apply (std::span<const DesiredBridge>, bool)
+{
+    throw runtime_error("apply needs netlink");
 }
 
 void Fallback::getDevicesAndBridges ()
 {
-    for (const auto &entry : fs::directory_iterator("/sys/class/net")) {
-        if (entry.is_directory()) {
-            const fs::path bridgeProps = entry.path() / "bridge";
+    _topology.clear();
 
-            if (fs::exists(bridgeProps) && fs::is_directory(bridgeProps))
-                _bridges[fs::path(entry).filename()] = getBridge(entry);
-            else
-                _devices[fs::path(entry).filename()] = getDevice(entry);
-        }
+    vector<Entry> entries = makeEntries(listDirectory(sysfs(), "."));
+    readEntries(entries);
+    store(entries);
+    linkPorts(entries);
+}
+
+void Fallback::getBridges (std::span<const std::string> bridges)
+{
+    // sysfs shows the namespace it was mounted in whatever thread reads it
+    if (_showOptions.allNetns)
+        throw runtime_error("show --all-netns needs netlink");
+
+    if (bridges.empty())
+        return getDevicesAndBridges();
+
+    _topology.clear();
+
+    vector<Entry> entries = makeEntries(bridges);
+    readEntries(entries);
+    store(entries);
+
+    // The ports are needed only by name as well
+    vector<string> portNames;
+    for (const Entry &entry : entries)
+        for (const string &port : entry.ports)
+            if (! _topology.find(port))
+                portNames.push_back(port);
+
+    vector<Entry> ports = makeEntries(portNames);
+    readEntries(ports);
+    store(ports);
+    linkPorts(entries);
+}
+
+int Fallback::sysfs ()
+{
+    if (! _sysfs) {
+        _sysfs = FileDescriptor(open(SysClassNet,
+                                     O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (! _sysfs)
+            throw runtime_error(format("Failed to open {}: {}",
+                                       SysClassNet, strerror(errno)));
+    }
+    return _sysfs.fd();
+}
+
+int Fallback::control ()
+{
+    if (! _control) {
+        _control = FileDescriptor(socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC,
+                                         0));
+        if (! _control)
+            throw runtime_error(format("Failed to create socket: {}",
+                                       strerror(errno)));
+    }
+    return _control.fd();
+}
+
+/* What if_nametoindex() does but without a socket per call */
+int Fallback::indexOf (const std::string &name)
+{
+    if (auto it = _indexes.find(name); it != _indexes.end())
+        return it->second;
+
+    if (name.empty() || name.size() >= IFNAMSIZ)
+        return 0;
+
+    ifreq ifr {};
+    name.copy(ifr.ifr_name, IFNAMSIZ - 1);
+    if (ioctl(control(), SIOCGIFINDEX, &ifr) < 0) {
+        if (errno == ENODEV)
+            return 0;
+        throw runtime_error(format("can't get index of {}: {}",
+                                   name, strerror(errno)));
+    }
+
+    _indexes.emplace(name, ifr.ifr_ifindex);
+    return ifr.ifr_ifindex;
+}
+
+int Fallback::bridgeIoctl (unsigned long request, const std::string &bridge,
+                           int ifindex)
+{
+    if (bridge.empty() || bridge.size() >= IFNAMSIZ)
+        return EINVAL;
+
+    // SIOCBRADDBR and SIOCBRDELBR take just the name
+    if (request == SIOCBRADDBR || request == SIOCBRDELBR) {
+        char name [IFNAMSIZ] {};
+        bridge.copy(name, IFNAMSIZ - 1);
+        return ioctl(control(), request, name) < 0 ? errno : 0;
     }
+
+    ifreq ifr {};
+    bridge.copy(ifr.ifr_name, IFNAMSIZ - 1);
+    ifr.ifr_ifindex = ifindex;
+    return ioctl(control(), request, &ifr) < 0 ? errno : 0;
 }
 
-Device Fallback::getDevice (const fs::directory_entry &dir)
+vector<Fallback::Entry> Fallback::makeEntries (span<const string> names)
 {
-    Device dev (fs::path(dir).filename());
+    vector<Entry> entries (names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        entries[i].link.name = _arena.intern(names[i]);
+    return entries;
+}
 
-    if (fs::is_regular_file(dir.path() / "ifindex"))
-        dev.index = readFile<decltype(dev.index)>(
-            dir.path() / "ifindex");
+/* Interfaces are taken by chunks from a shared counter, so a slow one
+ * doesn't hold back the rest. The first failure is rethrown */
+void Fallback::readEntries (span<Entry> entries)
+{
+    Stats::Timer timer (Stats::Phase::ReceiveWait);
+    const unsigned threads = entries.size() < ParallelThreshold
+        ? 1 : clamp(thread::hardware_concurrency(), 1u, MaxThreads);
+
+    // Opened before the threads start
+    const int root = sysfs();
+    atomic<size_t> next = 0;
+    vector<exception_ptr> errors (threads);
+
+    auto work = [&](unsigned id) {
+        try {
+            for (size_t begin; (begin = next.fetch_add(ReadChunk)) <
+                               entries.size(); ) {
+                const size_t end = min(begin + ReadChunk, entries.size());
+                for (size_t i = begin; i < end; ++i)
+                    readEntry(entries[i], root);
+            }
+        } catch (...) {
+            errors[id] = current_exception();
+            next = entries.size();
+        }
+    };
 
-    if (fs::is_regular_file(dir.path() / "operstate"))
-        dev.operstate = readFile<decltype(dev.operstate)>(
-            dir.path() / "operstate");
+    {
+        vector<jthread> pool;
+        for (unsigned id = 1; id < threads; ++id)
+            pool.emplace_back(work, id);
+        work(0);
+    }
 
-    if (! dev.isSane())
-        throw runtime_error(format("Failed to get interface properties from {}",
-                                   dir.path().string()));
-    return dev;
+    for (const exception_ptr &error : errors)
+        if (error)
+            rethrow_exception(error);
 }
 
-Bridge Fallback::getBridge (const fs::directory_entry &dir)
+/* Runs on the pool threads: touches nothing but the entry */
+void Fallback::readEntry (Entry &entry, int root)
 {
-    Bridge br (getDevice(dir));
-    const auto propDir = dir.path() / "bridge";
+    Link &link = entry.link;
+
+    // The name was interned so it's null-terminated
+    FileDescriptor dir (openat(root, link.name.data(),
+                               O_PATH | O_DIRECTORY | O_CLOEXEC));
+    if (! dir) {
+        // Gone since listed, or not an interface like bonding_masters
+        if (errno == ENOENT || errno == ENOTDIR)
+            return;
+        throw runtime_error(format("Failed to open {}/{}: {}", SysClassNet,
+                                   link.name, strerror(errno)));
+    }
+
+    array<char, AttributeSize> buffer;
+    string_view value;
+
+    if (! readAttribute(dir.fd(), "ifindex", buffer, value))
+        return;
+    link.index = parseAttribute<int>(value);
+
+    if (readAttribute(dir.fd(), "operstate", buffer, value))
+        link.operstate = parseAttribute<Operstate>(value);
+
+    if (! link.isSane())
+        throw runtime_error(format("Failed to get interface properties from "
+                                   "{}/{}", SysClassNet, link.name));
 
-    if (fs::is_regular_file(propDir / "bridge_id"))
-        br.bridge_id = readFile<decltype(br.bridge_id)>(propDir / "bridge_id");
+    // Only bridges have the bridge/ directory
+    if (readAttribute(dir.fd(), "bridge/bridge_id", buffer, value)) {
+        link.bridge = true;
+        link.bridge_id = parseAttribute<BridgeId>(value);
 
-    if (fs::is_regular_file(propDir / "stp_state"))
-        br.stp_state = readFile<decltype(br.stp_state)>(propDir / "stp_state");
+        if (readAttribute(dir.fd(), "bridge/stp_state", buffer, value))
+            link.stp_state = parseAttribute<bool>(value);
 
-    if (! br.isSane())
-        throw runtime_error(format("Failed to get bridge properties from {}",
-                                   dir.path().string()));
+        entry.ports = listDirectory(dir.fd(), "brif");
+    }
+
+    entry.present = true;
+}
 
-    return br;
+void Fallback::store (span<const Entry> entries)
+{
+    Stats::Timer timer (Stats::Phase::Topology);
+    for (const Entry &entry : entries)
+        if (entry.present)
+            _topology.insert(entry.link);
+}
+
+void Fallback::linkPorts (span<const Entry> entries)
+{
+    Stats::Timer timer (Stats::Phase::Topology);
+    for (const Entry &entry : entries) {
+        if (! entry.present)
+            continue;
+        for (const string &name : entry.ports)
+            if (const Link *port = _topology.find(name))
+                _topology.setMaster(port->index, entry.link.index);
+    }
 }
 
 template<class T>
-T Fallback::readFile(const fs::path &path)
-{
-    ifstream is (path.string());
-    if (! is.good() )
-        throw runtime_error(format("Failed to get information from {}",
-                                   path.string()));
-
-    stringstream ss;
-    ss << is.rdbuf();
-    string tmp;
-    getline(ss, tmp); // strip string
-
-    if constexpr (is_same_v<string, T>)
-        return tmp;
-    else if constexpr (is_same_v<int, T>)
-        return stoi(tmp);
+T Fallback::parseAttribute (string_view value)
+{
+    if constexpr (is_same_v<int, T>) {
+        int result = 0;
+        from_chars(value.data(), value.data() + value.size(), result);
+        return result;
+    }
     else if constexpr (is_same_v<bool, T>)
-        return tmp == "1";
+        return value == "1";
+    else if constexpr (is_same_v<Operstate, T>) {
+        // sysfs gives the same names but in lower case
+        for (uint8_t i = 0; i <= static_cast<uint8_t>(Operstate::Up); ++i) {
+            const auto state = static_cast<Operstate>(i);
+            if (ranges::equal(operstateName(state), value, {}, {}, ::toupper))
+                return state;
+        }
+        return Operstate::Unknown;
+    }
+    else if constexpr (is_same_v<BridgeId, T>) {
+        // Something like 8000.0a1b2c3d4e5f
+        BridgeId id {};
+        size_t i = 0;
+        for (size_t pos = 0; i < id.size() && pos + 1 < value.size(); ) {
+            if (value[pos] == '.') {
+                ++pos;
+                continue;
+            }
+            from_chars(value.data() + pos, value.data() + pos + 2, id[i++], 16);
+            pos += 2;
+        }
+        return id;
+    }
     else
         static_assert(false, "Don't know how to convert");
 }
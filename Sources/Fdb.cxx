@@ -0,0 +1,72 @@
+#include <linux/neighbour.h>
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#include "Fdb.hxx"
+
+/* LSD radix sort over the bytes of the key, least significant first. Each
+ * pass is stable, so the order of the earlier passes survives among equal
+ * bytes. Passes where all the entries share the byte, e.g. the high bytes
+ * of ifindexes or of unused VLANs, change nothing and are skipped */
+void sortFdb (std::vector<FdbEntry> &entries)
+{
+    std::vector<FdbEntry> scratch (entries.size());
+
+    auto pass = [&](auto byteOf) {
+        std::array<size_t, 256> counts {};
+        for (const FdbEntry &entry : entries)
+            ++counts[byteOf(entry)];
+        if (std::ranges::find(counts, entries.size()) != counts.end())
+            return;
+
+        std::array<size_t, 256> offsets;
+        std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(),
+                            size_t(0));
+        for (const FdbEntry &entry : entries)
+            scratch[offsets[byteOf(entry)]++] = entry;
+        entries.swap(scratch);
+    };
+
+    for (unsigned i = 0; i < sizeof(FdbEntry::vlan); ++i)
+        pass([i](const FdbEntry &entry) {
+            return uint8_t(entry.vlan >> 8 * i);
+        });
+    for (unsigned i = sizeof(FdbEntry::mac); i-- > 0; )
+        pass([i](const FdbEntry &entry) {
+            return entry.mac[i];
+        });
+    for (unsigned i = 0; i < sizeof(FdbEntry::port); ++i)
+        pass([i](const FdbEntry &entry) {
+            return uint8_t(uint32_t(entry.port) >> 8 * i);
+        });
+}
+
+void printFdb (Output &out, const Topology &topology,
+               std::span<const FdbEntry> entries)
+{
+    out.put("port\tmac addr\t\tvlan\tis local?\tageing timer\n");
+
+    // Entries go by port so the name changes rarely
+    int32_t port = 0;
+    std::string_view name;
+
+    for (const FdbEntry &entry : entries) {
+        if (entry.port != port || name.empty()) {
+            port = entry.port;
+            const Link *link = topology.find(port);
+            name = link ? link->name : std::string_view("?");
+        }
+
+        const uint8_t *mac = entry.mac;
+        out.print("{}\t{:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x}\t",
+                  name, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        if (entry.vlan)
+            out.print("{}\t", entry.vlan);
+        else
+            out.put("-\t");
+        out.print("{}\t\t{:4}.{:02}\n",
+                  entry.state & NUD_PERMANENT ? "yes" : "no",
+                  entry.ageing / 100, entry.ageing % 100);
+    }
+}
@@ -0,0 +1,149 @@
+#include "KernelTransport.hxx"
+
+KernelTransport::KernelTransport () :
+    KernelTransport(Options())
+{}
+
+// The timer lives until the delegated constructor returns
+KernelTransport::KernelTransport (const Options &options) :
+    KernelTransport(options, Stats::Timer(Stats::Phase::SocketSetup))
+{}
+
+KernelTransport::KernelTransport (const Options &options,
+                                  const Stats::Timer &) :
+    _address{.nl_family = AF_NETLINK}
+{
+    setOptsMakeChecks(options);
+}
+
+void KernelTransport::send (std::span<iovec> messages)
+{
+    sockaddr_nl kernel {.nl_family = AF_NETLINK};
+    msghdr msg {.msg_name = &kernel, .msg_namelen = sizeof(kernel),
+                .msg_iov = messages.data(), .msg_iovlen = messages.size()};
+
+    size_t bytesToSend = 0;
+    for (const iovec &iov : messages)
+        bytesToSend += iov.iov_len;
+
+    Stats::Timer timer (Stats::Phase::Send);
+    Stats::add(Stats::Counter::Syscalls);
+    const ssize_t bytesSend = sendmsg(_sock.fd(), &msg, 0);
+    if (bytesSend == -1)
+        throw std::runtime_error(std::format("Failed to sendmsg(), {}",
+                                             std::strerror(errno)));
+    else if (static_cast<size_t>(bytesSend) != bytesToSend)
+        throw std::runtime_error(std::format("Incorrect sendmsg() bytes: "
+                                             "sent {}, must be {}",
+                                             bytesSend, bytesToSend));
+    Stats::add(Stats::Counter::BytesSent, bytesSend);
+}
+
+size_t KernelTransport::peek ()
+{
+    Stats::Timer timer (Stats::Phase::ReceiveWait);
+
+    while (true) {
+        Stats::add(Stats::Counter::Syscalls);
+        // MSG_TRUNC makes it return the real size of the datagram
+        const ssize_t size = recv(_sock.fd(), nullptr, 0,
+                                  MSG_PEEK | MSG_TRUNC);
+        if (size < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            if (errno == ENOBUFS)
+                throw Overrun("Netlink receive queue overrun");
+            throw std::runtime_error(std::format("Failed to peek, {}",
+                                                 std::strerror(errno)));
+        }
+        return size;
+    }
+}
+
+std::span<uint8_t> KernelTransport::receive (std::span<uint8_t> buffer)
+{
+    sockaddr_nl kernel;
+    iovec iov {.iov_base = buffer.data(), .iov_len = buffer.size()};
+    msghdr msg {.msg_name = &kernel, .msg_namelen = sizeof(kernel),
+                .msg_iov = &iov, .msg_iovlen = 1};
+    Stats::Timer timer (Stats::Phase::ReceiveWait);
+
+    while (true) {
+        Stats::add(Stats::Counter::Syscalls);
+        const ssize_t bytesReceived = recvmsg(_sock.fd(), &msg, 0);
+        if (bytesReceived < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            if (errno == ENOBUFS)
+                throw Overrun("Netlink receive queue overrun");
+            throw std::runtime_error(std::format("Failed to recvmsg(), {}",
+                                                 std::strerror(errno)));
+        }
+
+        if (msg.msg_flags & MSG_TRUNC)
+            throw std::runtime_error("Truncated message");
+
+        Stats::add(Stats::Counter::BytesReceived, bytesReceived);
+        return buffer.first(bytesReceived);
+    }
+}
+
+void KernelTransport::subscribe (unsigned group)
+{
+    if (setsockopt(_sock.fd(), SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                   &group, sizeof(group)) < 0)
+        throw std::runtime_error(std::format("Failed to join group {}: {}",
+                                             group, std::strerror(errno)));
+}
+
+void KernelTransport::setOptsMakeChecks (const Options &options)
+{
+    const int one = 1;
+    const int fd = _sock.fd();
+    // socket(), NETLINK_GET_STRICT_CHK, bind() and getsockname()
+    Stats::add(Stats::Counter::Syscalls, 4);
+
+    setBufferSize(SO_SNDBUFFORCE, SO_SNDBUF, options.sndBufSize, "SO_SNDBUF");
+    setBufferSize(SO_RCVBUFFORCE, SO_RCVBUF, options.rcvBufSize, "SO_RCVBUF");
+
+    if (setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK,
+                   &one, sizeof(one)) < 0)
+        throw std::runtime_error("Failed to set NETLINK_GET_STRICT_CHK");
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&_address),
+             sizeof(_address)) < 0)
+        throw std::runtime_error("Failed to bind socket");
+
+    socklen_t chkAddrSize = sizeof(_address);
+
+    if (getsockname(fd, reinterpret_cast<sockaddr *>(&_address),
+                    &chkAddrSize) < 0)
+        throw std::runtime_error("Failed to getsockname()");
+
+    if (chkAddrSize != sizeof(_address))
+        throw std::runtime_error(std::format("Got invalid address length {}",
+                                             chkAddrSize));
+
+    if (_address.nl_family != AF_NETLINK)
+        throw std::runtime_error(std::format("Got invalid address family {}",
+                                             _address.nl_family));
+}
+
+void KernelTransport::setBufferSize (int forceOption, int option, int size,
+                                     const char *name)
+{
+    const int fd = _sock.fd();
+
+    // Unprivileged size is silently limited by net.core.[rw]mem_max
+    Stats::add(Stats::Counter::Syscalls);
+    if (setsockopt(fd, SOL_SOCKET, forceOption, &size, sizeof(size)) == 0)
+        return;
+    if (errno != EPERM)
+        throw std::runtime_error(std::format("Failed to set {}: {}", name,
+                                             std::strerror(errno)));
+
+    Stats::add(Stats::Counter::Syscalls);
+    if (setsockopt(fd, SOL_SOCKET, option, &size, sizeof(size)) < 0)
+        throw std::runtime_error(std::format("Failed to set {}: {}", name,
+                                             std::strerror(errno)));
+}
@@ -1,43 +1,75 @@
+#include <linux/if_ether.h>
 #include <linux/netlink.h>
-#include <sstream>
+#include <poll.h>
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 #include "Netlink.hxx"
+#include "Netns.hxx"
+#include "Output.hxx"
 #include "Request.hxx"
+#include "Stats.hxx"
+
+// How many times to retry a dump interrupted by changes
+static constexpr int maxDumpRestarts = 8;
+// Updates a resident topology takes before it's taken anew, so the names
+// and replies they leave in the arena don't pile up forever
+static constexpr size_t maxResidentEvents = 64 * 1024;
 
 void Netlink::show (std::span<const std::string> bridges)
 {
-    bool headerPrinted = false;
+    Output out;
+    auto printer = ShowPrinter::create(_showOptions.format, out);
 
-    auto printBridge = [&](const std::string &iface) {
-        if (! _devices.contains(iface) && ! _bridges.contains(iface))
-            std::cout << std::format("bridge {} does not exist!", iface)
-                      << std::endl;
-        else if (! _bridges.contains(iface))
-            std::cout << std::format("device {} is not a bridge!", iface)
-                      << std::endl;
-        else if (_bridges.contains(iface)) {
-            if (! headerPrinted) {
-                std::cout << std::format("{}\t{}\t\t{}\t{}",
-                                         "bridge name", "bridge id",
-                                         "STP enabled", "interfaces")
-                          << std::endl;
-                headerPrinted = true;
-            }
-            auto masters = [&](const std::string &br){
-                std::stringstream sstr;
-                int counter = _relations.count(br);
-                auto range = _relations.equal_range(br);
-                for (auto it = range.first; it != range.second; ++it)
-                    sstr << it->second << (--counter ? ", " : "");
-                return sstr.str();
-            };
-            std::cout << std::format("{}\t\t{}\t{}\t\t{}",
-                                     iface, _bridges[iface].bridge_id,
-                                     _bridges[iface].stp_state ? "yes" : "no",
-                                     masters(iface))
-                      << std::endl;
+    if (_showOptions.allNetns) {
+        for (NetnsTopology &ns : _netns) {
+            printer->netns(ns.name);
+            if (ns.netlink)
+                ns.netlink->printBridges(bridges, *printer, out);
+            else
+                printer->error(ns.error);
+        }
+        _netns.clear();
+    }
+    else
+        printBridges(bridges, *printer, out);
+
+    printer->finish();
+    out.flush();
+}
+
+void Netlink::printBridges (std::span<const std::string> bridges,
+                            ShowPrinter &printer, Output &out)
+{
+    auto printBridge = [&](std::string_view iface) {
+        const Link *br = _topology.find(iface);
+
+        // Only bridges and their ports may be known so ask the kernel,
+        // unless every link is known
+        const bool exists = br || (! _resident &&
+                                   lookup(std::string(iface)));
+        if (! exists)
+            return printer.missing(iface);
+        if (! br || ! br->isBridge())
+            return printer.notBridge(iface);
+
+        // Unsorted show takes the ports of one bridge at a time
+        if (_portsPending && ! getPorts(*br)) {
+            _portsPending = false;
+            _topology.clear();
+            getDevicesAndBridges();
+            br = _topology.find(iface);
+        }
+
+        {
+            Stats::Timer timer (Stats::Phase::Format);
+            printer.bridge(_topology, *br);
         }
+
+        // The row is complete so don't keep it waiting
+        if (_showOptions.unsorted)
+            out.flush();
     };
 
     // If some parameters to 'show' given
@@ -45,127 +77,398 @@ void Netlink::show (std::span<const std::string> bridges)
         for (const auto &iface : bridges)
             printBridge(iface);
 
-    // Print all bridges if 'show' is bare
-    else if (_bridges.size())
-        for (const auto &iface : _bridges)
-            printBridge(iface.first);
+    // Print all bridges if 'show' is bare, by name or in the kernel's order
+    else {
+        std::vector<std::string_view> names;
+        if (_showOptions.unsorted) {
+            for (const Link &link : _topology.links())
+                if (link.index && link.isBridge())
+                    names.push_back(link.name);
+        } else
+            for (int br : _topology.bridges())
+                names.push_back(_topology.find(br)->name);
+
+        for (std::string_view name : names)
+            printBridge(name);
+    }
 }
 
 void Netlink::addbr (const std::string &bridge)
 {
-    if (_bridges.count(bridge) || _devices.count(bridge))
-        throw std::runtime_error(
+    if (resolve(bridge))
+        throw NetlinkError(EEXIST,
             std::format("device {} already exists; can't create bridge with "
                         "the same name", bridge));
 
-    Message::LinkRequest request (RTM_NEWLINK,
-                                  NLM_F_REQUEST | NLM_F_CREATE |
-                                     NLM_F_EXCL | NLM_F_ACK);
-    addAttr<std::string, decltype(request)>(&request.hdr, IFLA_IFNAME, bridge);
-
-    // Add empty attr IFLA_LINKINFO with nested attr IFLA_INFO_KIND
-    rtattr * linkInfoAttr =
-        addAttr<EmptyAttr, decltype(request)>(&request.hdr, IFLA_LINKINFO);
-    rtattr * attr = addAttr<std::string, decltype(request)>(&request.hdr,
-                                                            IFLA_INFO_KIND,
-                                                            "bridge");
-    --attr->rta_len; // somehow IFLA_INFO_KIND shouldn't contain '\0'
-
-    // Calculate IFLA_LINKINFO size
-    linkInfoAttr->rta_len = NLMSG_NESTED_RTA_SIZE(&request.hdr, linkInfoAttr);
+    auto build = [&](auto &request) {
+        request.template put<Message::IfName>(bridge);
+        addBridgeKind(request);
+    };
 
     auto errHandler = [&](nlmsgerr *err) {
         if (err->error)
-            throw std::runtime_error(
+            throw NetlinkError(-err->error,
                 std::format("add bridge failed: {}",
                             std::strerror(-err->error)));
     };
 
-    talkWithKernel(request, errHandler);
+    submit<Message::NewBridge>(RTM_NEWLINK,
+                               NLM_F_REQUEST | NLM_F_CREATE |
+                                   NLM_F_EXCL | NLM_F_ACK,
+                               build, errHandler);
+    // Index is unknown until it's created
+    if (_batching)
+        _created.insert(bridge);
 }
 
 void Netlink::delbr (const std::string &bridge)
 {
-    if (! _bridges.contains(bridge))
-        throw std::runtime_error(
+    const auto br = resolve(bridge);
+    if (! br || ! br->isBridge())
+        throw NetlinkError(ENODEV,
             std::format("bridge {} doesn't exist; can't delete it", bridge));
 
-    Message::LinkRequest request (RTM_DELLINK,
-                                  NLM_F_REQUEST | NLM_F_ACK);
-    request.ifi.ifi_index = _bridges[bridge].index;
-    rtattr * linkInfoAttr =
-        addAttr<EmptyAttr, decltype(request)>(&request.hdr, IFLA_LINKINFO);
-    rtattr * attr = addAttr<std::string, decltype(request)>(&request.hdr,
-                                                            IFLA_INFO_KIND,
-                                                            "bridge");
-    --attr->rta_len; // IFLA_INFO_KIND shouldn't contain '\0'
-
-    // Calculate IFLA_LINKINFO size
-    linkInfoAttr->rta_len = NLMSG_NESTED_RTA_SIZE(&request.hdr, linkInfoAttr);
+    auto build = [&](auto &request) {
+        request.family().ifi_index = br->index;
+        addBridgeKind(request);
+    };
 
     auto errHandler = [&](nlmsgerr *err) {
         if (err->error)
-            throw std::runtime_error(
+            throw NetlinkError(-err->error,
                 std::format("can't delete bridge {}: {}",
                             bridge, std::strerror(-err->error)));
     };
 
-    talkWithKernel(request, errHandler);
+    submit<Message::DelBridge>(RTM_DELLINK, NLM_F_REQUEST | NLM_F_ACK,
+                               build, errHandler);
+    // The ports are left without a master the way the kernel leaves them
+    detachPorts(br->index, [](const Link *, const Link *) {});
+    _topology.erase(br->index);
 }
 
 void Netlink::addif (const std::string &bridge, const std::string &device)
 {
-    if (! _devices.contains(device))
-        throw std::runtime_error(
+    const auto dev = resolve(device);
+    if (! dev || dev->isBridge())
+        throw NetlinkError(ENODEV,
             std::format("interface {} doest not exist!", device));
 
-    if (! _bridges.contains(bridge))
-        throw std::runtime_error(
+    const auto br = resolve(bridge);
+    if (! br || ! br->isBridge())
+        throw NetlinkError(ENODEV,
             std::format("bridge {} does not exist!", bridge));
 
     // Send RTM_NEWLINK with eth0 index in ifi and bridge index in IFLA_MASTER
-    Message::LinkRequest request (RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
-    request.ifi.ifi_index = _devices[device].index;
-    addAttr<uint32_t, decltype(request)>(&request.hdr, IFLA_MASTER,
-                                         _bridges[bridge].index);
+    auto build = [&](auto &request) {
+        request.family().ifi_index = dev->index;
+        request.template put<Message::Master>(br->index);
+    };
 
     auto errHandler = [&](nlmsgerr *err) {
         if (err->error)
-            throw std::runtime_error(
+            throw NetlinkError(-err->error,
                 std::format("can't add {} to bridge {}: {}",
                             device, bridge, std::strerror(-err->error)));
     };
 
-    talkWithKernel(request, errHandler);
+    submit<Message::SetMaster>(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK,
+                               build, errHandler);
+    _topology.setMaster(dev->index, br->index);
 }
 
 void Netlink::delif (const std::string &bridge, const std::string &device)
 {
-    if (! _devices.contains(device))
-        throw std::runtime_error(
+    const auto dev = resolve(device);
+    if (! dev || dev->isBridge())
+        throw NetlinkError(ENODEV,
             std::format("interface {} doest not exist!", device));
 
-    if (! _bridges.contains(bridge))
-        throw std::runtime_error(
+    const auto br = resolve(bridge);
+    if (! br || ! br->isBridge())
+        throw NetlinkError(ENODEV,
             std::format("bridge {} does not exist!", bridge));
 
-    if (! isMaster(device, bridge))
-        throw std::runtime_error(
+    if (dev->master != static_cast<uint32_t>(br->index))
+        throw NetlinkError(EINVAL,
             std::format("device {} is not a port of {}", device, bridge));
 
     // Send RTM_NEWLINK with eth0 index in ifi and bridge index in IFLA_MASTER
-    Message::LinkRequest request (RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
-    request.ifi.ifi_index = _devices[device].index;
-    addAttr<uint32_t, decltype(request)>(&request.hdr, IFLA_MASTER, 0);
+    auto build = [&](auto &request) {
+        request.family().ifi_index = dev->index;
+        request.template put<Message::Master>(0);
+    };
 
     auto errHandler = [&](nlmsgerr *err) {
         if (err->error)
-            throw std::runtime_error(
+            throw NetlinkError(-err->error,
                 std::format("can't delete {} from {}: {}",
                             device, bridge, std::strerror(-err->error)));
     };
 
-    talkWithKernel(request, errHandler);
+    submit<Message::SetMaster>(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK,
+                               build, errHandler);
+    _topology.setMaster(dev->index, 0);
+}
+
+void Netlink::stp (const std::string &bridge, bool on)
+{
+    // The kernel finds a bridge created earlier in the batch by its name
+    if (! _batching || ! _created.contains(bridge)) {
+        const auto br = resolve(bridge);
+        if (! br || ! br->isBridge())
+            throw NetlinkError(ENODEV,
+                std::format("bridge {} does not exist!", bridge));
+    }
+
+    auto build = [&](auto &request) {
+        request.template put<Message::IfName>(bridge);
+        addBridgeKind(request, on);
+    };
+
+    auto errHandler = [&](nlmsgerr *err) {
+        if (err->error)
+            throw NetlinkError(-err->error,
+                std::format("can't set stp of {}: {}",
+                            bridge, std::strerror(-err->error)));
+    };
+
+    submit<Message::SetBridge>(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK,
+                               build, errHandler);
+
+    /* No RTM_NEWLINK follows a change of the bridge options alone (as of
+     * Linux 6.18), so the daemon takes the bridge again */
+    if (_resident)
+        if (const auto br = lookup(bridge))
+            _topology.insert(*br);
+}
+
+/* The difference is run as a batch of the usual commands, so creating
+ * bridges goes before adding their ports and all the requests share one
+ * socket. Nothing is sent when there is no difference: a converged host
+ * costs the single dump of beginBatch().
+ *
+ * A command is reported once the kernel has acknowledged its requests:
+ * the way it would be given by hand if they succeeded, with the error
+ * otherwise. The reports are printed in the order of the plan */
+void Netlink::apply (std::span<const DesiredBridge> bridges, bool prune)
+{
+    beginBatch();
+
+    // Kept until the batch is committed: the handlers refer to the names
+    const std::vector<std::vector<std::string>> commands =
+        plan(bridges, prune);
+    std::vector<std::string> reports (commands.size());
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        std::string &report = reports[i];
+        std::string done;
+        for (const std::string &word : commands[i])
+            done.append(done.empty() ? "" : " ").append(word);
+
+        // The first failed request of the command is reported
+        _wrapErrHandle = [&report, done](ErrCallback handle) -> ErrCallback {
+            return [&report, done, handle = std::move(handle)]
+                   (nlmsgerr *err) {
+                try {
+                    if (handle != nullptr)
+                        handle(err);
+                    if (report.empty())
+                        report = done;
+                } catch (std::exception &e) {
+                    if (report.empty() || report == done)
+                        report = e.what();
+                }
+            };
+        };
+
+        try {
+            dispatch(commands[i]);
+        } catch (std::exception &e) {
+            report = e.what();
+        }
+    }
+    _wrapErrHandle = nullptr;
+
+    commitBatch();
+
+    for (const std::string &report : reports)
+        if (! report.empty())
+            std::cout << report << std::endl;
+}
+
+std::vector<std::vector<std::string>> Netlink::plan (
+    std::span<const DesiredBridge> bridges, bool prune) const
+{
+    std::vector<std::vector<std::string>> commands;
+    std::unordered_set<std::string_view> desired;
+    for (const DesiredBridge &bridge : bridges)
+        desired.insert(bridge.name);
+
+    if (prune)
+        for (int index : _topology.bridges())
+            if (const Link *br = _topology.find(index);
+                ! desired.contains(br->name))
+                commands.push_back({"delbr", std::string(br->name)});
+
+    for (const DesiredBridge &bridge : bridges) {
+        const Link *br = _topology.find(bridge.name);
+        const bool exists = br && br->isBridge();
+        // New bridges have STP off
+        const bool stp = exists && br->stp_state;
+
+        if (! exists)
+            commands.push_back({"addbr", bridge.name});
+        if (bridge.stp && *bridge.stp != stp)
+            commands.push_back({"stp", bridge.name, *bridge.stp ? "on" : "off"});
+    }
+
+    // A port moves from one bridge to another with addif alone
+    std::unordered_set<std::string_view> ports;
+    for (const DesiredBridge &bridge : bridges) {
+        const Link *br = _topology.find(bridge.name);
+        for (const std::string &port : bridge.ports) {
+            const Link *link = _topology.find(port);
+            ports.insert(port);
+            if (! br || ! link ||
+                link->master != static_cast<uint32_t>(br->index))
+                commands.push_back({"addif", bridge.name, port});
+        }
+    }
+
+    for (const DesiredBridge &bridge : bridges)
+        if (const Link *br = _topology.find(bridge.name); br && br->isBridge())
+            for (int index : _topology.ports(br->index))
+                if (const Link *port = _topology.find(index);
+                    ! ports.contains(port->name))
+                    commands.push_back({"delif", bridge.name,
+                                        std::string(port->name)});
+    return commands;
+}
+
+/* The batch works with the topology taken once here */
+void Netlink::beginBatch ()
+{
+    getDevicesAndBridges();
+    _batching = true;
+}
+
+void Netlink::commitBatch ()
+{
+    Message::Batch batch = std::move(_batch);
+    std::vector<ErrCallback> errHandles = std::move(_batchErrHandles);
+    std::vector<std::string> errors;
+    _batch.clear();
+    _batchErrHandles.clear();
+    _batching = false;
+
+    // Don't let a failed request to abort handling of the rest
+    for (auto &errHandle : errHandles)
+        errHandle = [&errors, handle = std::move(errHandle)]
+                    (nlmsgerr *err) {
+            try {
+                if (handle != nullptr)
+                    handle(err);
+            } catch (std::exception &e) {
+                errors.push_back(e.what());
+            }
+        };
+
+    talkWithKernel(batch, errHandles);
+
+    for (const auto &error : errors)
+        std::cout << error << std::endl;
+}
+
+template <class TLayout, class Build>
+void Netlink::submit (uint16_t type, uint16_t flags, Build &&build,
+                      ErrCallback errHandle, size_t space)
+{
+    if (_batching) {
+        auto request = _batch.add<TLayout>(type, flags, space);
+        build(request);
+        _batchErrHandles.push_back(_wrapErrHandle != nullptr ?
+                                   _wrapErrHandle(std::move(errHandle)) :
+                                   std::move(errHandle));
+    }
+    else {
+        Message::Request<TLayout> request (type, flags);
+        build(request);
+        talkWithKernel(request.header(), errHandle);
+    }
+}
+
+void Netlink::flush ()
+{
+    const bool batching = _batching;
+
+    commitBatch();
+
+    /* The rest of the topology is kept by the batch as it goes, so only
+     * the bridges created are taken, one RTM_GETLINK each */
+    for (const std::string &name : _created)
+        if (const auto br = lookup(name))
+            _topology.insert(*br);
+    _created.clear();
+
+    _batching = batching;
+}
+
+std::optional<Link> Netlink::resolve (const std::string &name)
+{
+    // Batch works with the topology taken once at its beginning
+    if (! _batching)
+        return lookup(name);
+
+    // The bridge has been created earlier in the batch so take its index
+    if (_created.contains(name)) {
+        flush();
+        return resolve(name);
+    }
+
+    const Link *link = _topology.find(name);
+    return link ? std::optional(*link) : std::nullopt;
+}
+
+/* Ask the kernel for a single link instead of dumping all of them */
+std::optional<Link> Netlink::lookup (const std::string &name)
+{
+    // No link may have such a name
+    if (name.size() > Message::IfName::maxLength)
+        return std::nullopt;
+
+    Message::Request<Message::GetLink> request (RTM_GETLINK,
+                                                NLM_F_REQUEST | NLM_F_ACK);
+    request.put<Message::IfName>(name);
+    request.put<Message::ExtMask>(RTEXT_FILTER_SKIP_STATS);
+
+    std::optional<Link> link;
+
+    auto errHandler = [&](nlmsgerr *err) {
+        if (err->error && err->error != -ENODEV)
+            throw NetlinkError(-err->error,
+                std::format("can't get properties of {}: {}",
+                            name, std::strerror(-err->error)));
+    };
+
+    /* The reply isn't kept, only the name is. The daemon looks links up
+     * for as long as it runs, so its arena grows by new names only and
+     * they count towards the resync like the notifications */
+    auto msgHandler = [&](nlmsghdr *hdr) {
+        if (hdr->nlmsg_type != RTM_NEWLINK)
+            return;
+        parseLink(hdr, link.emplace());
+        if (const Link *known = _topology.find(link->name))
+            link->name = known->name;
+        else {
+            link->name = _arena.intern(link->name);
+            if (_resident)
+                ++_eventsApplied;
+        }
+    };
+
+    talkWithKernel(request.header(), errHandler, msgHandler);
+    return link;
 }
 
 /* Check if RTM_NEWLINK available.
@@ -173,7 +476,8 @@ void Netlink::delif (const std::string &bridge, const std::string &device)
  */
 bool Netlink::check()
 {
-    Message::LinkRequest request (RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
+    Message::Request<Message::Probe> request (RTM_NEWLINK,
+                                              NLM_F_REQUEST | NLM_F_ACK);
 
     bool supported = false;
     auto errHandler = [&supported](nlmsgerr *err){
@@ -181,91 +485,820 @@ bool Netlink::check()
             supported = true;
     };
 
-    talkWithKernel(request, errHandler);
+    talkWithKernel(request.header(), errHandler);
     return supported;
 }
 
+void Netlink::monitor ()
+{
+    startEvents();
+
+    auto print = [this](const Link *before, const Link *after) {
+        printChange(before, after);
+    };
+
+    while (true)
+        handleEvents(print);
+}
+
 void Netlink::getDevicesAndBridges ()
 {
-    // Prepare the request for the kernel
-    Message::LinkRequest request (RTM_GETLINK,
-                                  NLM_F_REQUEST | NLM_F_ACK | NLM_F_DUMP);
-    addAttr<uint32_t, decltype(request)>(&request.hdr, IFLA_EXT_MASK,
-                                         RTEXT_FILTER_VF |
-                                             RTEXT_FILTER_SKIP_STATS);
-
-    // Create a vector of fields that would be filled from nlmsghdr
-    struct Something : public Bridge {
-        uint32_t master;
-    };
-    std::vector<Something> results;
-
-    // Handler to parse BR nested attributes
-    auto bridgeAttrHandler = [&](uint16_t type, const rtattr * const attr) {
-        if (type == IFLA_BR_BRIDGE_ID)
-            results.back().bridge_id = getBridgeId(attr);
-        else if (type == IFLA_BR_STP_STATE)
-            results.back().stp_state = readAttr<uint32_t>(attr);
-    };
-
-    // Handler to parse INFO nested attributes
-    auto infoAttrHandler = [&](uint16_t type, const rtattr * const attr) {
-        static bool isBridge = false;
-        if (type == IFLA_INFO_KIND)
-            isBridge = readAttr<std::string_view>(attr) == "bridge";
-        else if (type == IFLA_INFO_DATA && isBridge) {
-            parseNestedAttrs(attr, bridgeAttrHandler);
-            isBridge = false;
+    DumpRequest request;
+    std::vector<Link> results;
+
+    dumpLinks(request, results);
+    storeLinks(results);
+}
+
+/* Ask the kernel for bridges only and then for ports of every bridge needed.
+ * Falls back to the full dump if the kernel rejects the filters */
+void Netlink::getBridges (std::span<const std::string> bridges)
+{
+    if (_showOptions.allNetns)
+        return getNetnsBridges(bridges);
+
+    _portsPending = false;
+
+    // Everything is known already, up to the pending notifications
+    if (_resident)
+        return applyEvents();
+
+    DumpRequest request;
+    std::vector<Link> results;
+    addBridgeKind(request);
+
+    if (! dumpLinks(request, results))
+        return getDevicesAndBridges();
+
+    // Old kernels may ignore the filter so check the kind again
+    std::erase_if(results, [](const Link &link) {
+        return ! link.isBridge();
+    });
+    storeLinks(results);
+
+    // Unsorted show takes the ports of every bridge right before printing it
+    _portsPending = _showOptions.unsorted;
+    if (_portsPending)
+        return;
+
+    bool accepted = true;
+    if (bridges.size()) {
+        for (const auto &name : bridges)
+            if (const Link *br = _topology.find(name); accepted && br)
+                accepted = getPorts(*br);
+    }
+    else
+        for (int br : _topology.bridges())
+            if (accepted)
+                accepted = getPorts(*_topology.find(br));
+
+    if (! accepted) {
+        _topology.clear();
+        getDevicesAndBridges();
+    }
+}
+
+/* Every worker thread enters the namespaces it takes one by one. A Netlink
+ * created there opens its socket in that namespace, so the topology may be
+ * printed later from any thread. A namespace that fails is only reported */
+void Netlink::getNetnsBridges (std::span<const std::string> bridges)
+{
+    if (capturing())
+        throw std::runtime_error("show --all-netns can't be recorded or "
+                                 "replayed");
+
+    _netns.clear();
+    for (std::string &name : Netns::list())
+        _netns.push_back({.name = std::move(name)});
+
+    ShowOptions options = _showOptions;
+    options.allNetns = false;
+
+    std::atomic<size_t> next = 0;
+    auto work = [&]() {
+        for (size_t i; (i = next++) < _netns.size(); ) {
+            NetnsTopology &ns = _netns[i];
+            try {
+                Netns::enter(ns.name);
+                auto netlink = std::make_unique<Netlink>();
+                netlink->_showOptions = options;
+                netlink->setSocketBuffers(socketOptions().sndBufSize,
+                                          socketOptions().rcvBufSize);
+                netlink->setPipelined(pipelined());
+                netlink->getBridges(bridges);
+                ns.netlink = std::move(netlink);
+            } catch (std::exception &e) {
+                ns.error = e.what();
+            }
         }
     };
 
-    // Handler to parse
-    auto attrHandler = [&](uint16_t type, const rtattr * const attr) {
-        if (type == IFLA_IFNAME)
-            results.back().name = readAttr<std::string_view>(attr);
-        else if (type == IFLA_MASTER)
-            results.back().master = readAttr<uint32_t>(attr);
-        else if (type == IFLA_OPERSTATE)
-            results.back().operstate = getOperstate(attr);
-        else if (type == IFLA_LINKINFO)
-            parseNestedAttrs(attr, infoAttrHandler);
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i < std::min(_netns.size(), MaxNetnsWorkers); ++i)
+        workers.emplace_back(work);
+}
+
+bool Netlink::getPorts (const Link &br)
+{
+    DumpRequest request;
+    std::vector<Link> results;
+    request.put<Message::Master>(br.index);
+
+    if (! dumpLinks(request, results))
+        return false;
+
+    std::erase_if(results, [&br](const Link &link) {
+        return link.master != static_cast<uint32_t>(br.index);
+    });
+    storeLinks(results);
+    return true;
+}
+
+/* Bridges come from the dump filtered by kind, since only IFLA_INFO_DATA
+ * holds their timers. Every port of every bridge comes then from a single
+ * AF_BRIDGE dump: the kernel puts only the ports into it, each with its
+ * IFLA_PROTINFO */
+void Netlink::getStp (std::unordered_map<int, BridgeStp> &bridges,
+                      std::unordered_map<int, PortStp> &ports)
+{
+    auto parseBridge = [&](const nlmsghdr *hdr, Link &link) {
+        BridgeStp stp;
+        parseLink(hdr, link, &stp);
+        if (link.isBridge())
+            bridges[link.index] = stp;
+    };
+
+    std::vector<Link> results;
+    {
+        DumpRequest request;
+        addBridgeKind(request);
+        if (! dumpLinks(request, results, parseBridge)) {
+            DumpRequest unfiltered;
+            dumpLinks(unfiltered, results, parseBridge);
+        }
+    }
+    std::erase_if(results, [](const Link &link) {
+        return ! link.isBridge();
+    });
+    storeLinks(results);
+
+    auto parsePort = [&](const nlmsghdr *hdr, Link &link) {
+        PortStp stp;
+        parseLink(hdr, link, nullptr, &stp);
+        ports[link.index] = stp;
     };
 
-    // Handler to parse Netlink messages
-    auto headerHandler = [&](nlmsghdr *hdr){
-        if (hdr->nlmsg_type == RTM_NEWLINK) {
-            results.push_back(Something{.master = 0});
+    DumpRequest request;
+    request.family().ifi_family = AF_BRIDGE;
+    dumpLinks(request, results, parsePort);
+    storeLinks(results);
+}
+
+void Netlink::showstp (std::span<const std::string> bridges)
+{
+    std::unordered_map<int, BridgeStp> bridgeStp;
+    std::unordered_map<int, PortStp> portStp;
+    getStp(bridgeStp, portStp);
+
+    Output out;
+    auto printBridge = [&](std::string_view iface) {
+        const Link *br = _topology.find(iface);
+        if (! br && ! lookup(std::string(iface)))
+            return out.print("bridge {} does not exist!\n", iface);
+        if (! br || ! br->isBridge())
+            return out.print("device {} is not a bridge!\n", iface);
 
-            ifinfomsg *ifi = reinterpret_cast<ifinfomsg *>(NLMSG_DATA(hdr));
-            results.back().index = ifi->ifi_index;
+        Stats::Timer timer (Stats::Phase::Format);
+        printBridgeStp(out, *br, bridgeStp[br->index]);
+        for (int port : _topology.ports(br->index))
+            printPortStp(out, *_topology.find(port), portStp[port]);
+    };
+
+    if (bridges.size())
+        for (const auto &iface : bridges)
+            printBridge(iface);
+    else
+        for (int br : _topology.bridges())
+            printBridge(_topology.find(br)->name);
+}
 
-            parseAttrs(hdr, attrHandler);
+/* The bridge and its ports are taken first to name the ports and to check
+ * the entries, then the entries are parsed right into the records */
+void Netlink::showmacs (const std::string &bridge)
+{
+    const std::optional<Link> br = lookup(bridge);
+    if (! br)
+        throw NetlinkError(ENODEV,
+            std::format("bridge {} does not exist!", bridge));
+    if (! br->isBridge())
+        throw NetlinkError(EINVAL,
+            std::format("device {} is not a bridge!", bridge));
+
+    _topology.insert(*br);
+    if (! getPorts(*br))
+        getDevicesAndBridges();
+
+    std::vector<FdbEntry> entries;
+    dumpFdb(*br, entries);
+    {
+        Stats::Timer timer (Stats::Phase::Topology);
+        sortFdb(entries);
+    }
+
+    Output out;
+    Stats::Timer timer (Stats::Phase::Format);
+    printFdb(out, _topology, entries);
+}
+
+/* Every port of the bridge takes the entries of the bridge learned on it,
+ * the bridge itself takes the local ones. The addresses the devices listen
+ * to come with NTF_SELF and aren't the bridge's so they are skipped. The
+ * kernel dumps only the bridge when asked with NDA_MASTER, older ones get
+ * everything and the entries are checked against the ports anyway */
+void Netlink::dumpFdb (const Link &br, std::vector<FdbEntry> &entries)
+{
+    auto belongs = [&](int index) {
+        const Link *port = _topology.find(index);
+        return index == br.index ||
+               (port && port->master == static_cast<uint32_t>(br.index));
+    };
+
+    bool accepted = true;
+    auto errHandler = [&](nlmsgerr *err) {
+        if (err->error == -EINVAL || err->error == -EOPNOTSUPP)
+            accepted = false;
+        else if (err->error)
+            throw NetlinkError(-err->error,
+                std::format("Failed to dump forwarding database: {}",
+                            std::strerror(-err->error)));
+    };
+
+    auto msgHandler = [&](nlmsghdr *hdr) {
+        if (hdr->nlmsg_type != RTM_NEWNEIGH)
+            return;
+
+        const ndmsg *ndm = reinterpret_cast<const ndmsg *>(NLMSG_DATA(hdr));
+        if (ndm->ndm_family != AF_BRIDGE || (ndm->ndm_flags & NTF_SELF) ||
+            ! belongs(ndm->ndm_ifindex))
+            return;
+
+        const rtattr *tb [NDA_MAX + 1] = {};
+        parseAttrs<ndmsg>(hdr, tb);
+        if (! tb[NDA_LLADDR] || RTA_PAYLOAD(tb[NDA_LLADDR]) != ETH_ALEN)
+            return;
+
+        FdbEntry &entry = entries.emplace_back();
+        entry = {.port = ndm->ndm_ifindex, .state = ndm->ndm_state};
+        std::memcpy(entry.mac, RTA_DATA(tb[NDA_LLADDR]), ETH_ALEN);
+        if (tb[NDA_VLAN])
+            entry.vlan = readAttr<uint16_t>(tb[NDA_VLAN]);
+        if (tb[NDA_CACHEINFO])
+            entry.ageing = reinterpret_cast<const nda_cacheinfo *>(
+                RTA_DATA(tb[NDA_CACHEINFO]))->ndm_updated;
+    };
+
+    for (bool filtered : {true, false}) {
+        Message::Request<Message::DumpNeigh> request (RTM_GETNEIGH,
+                                                      NLM_F_REQUEST |
+                                                          NLM_F_ACK |
+                                                          NLM_F_DUMP);
+        request.family().ndm_family = AF_BRIDGE;
+        if (filtered)
+            request.put<Message::NeighMaster>(br.index);
+
+        accepted = true;
+        for (int attempt = 0; attempt < maxDumpRestarts; ++attempt) {
+            entries.clear();
+            // Records hold no pointers into the replies so nothing is kept
+            const ErrorCode errorCode =
+                pipelined() ? pipelineWithKernel(request.header(),
+                                                 errHandler, msgHandler)
+                            : talkWithKernel(request.header(), errHandler,
+                                             msgHandler);
+            if (errorCode != ErrorCode::DumpInconsistent)
+                break;
+            Stats::add(Stats::Counter::DumpRestarts);
+        }
+        if (accepted)
+            return;
+    }
+}
+
+/* Ports come with their VLANs from one AF_BRIDGE dump, bridges come too
+ * since the VLAN filter is asked for. Compressed, a trunk of any number of
+ * VLANs is two entries */
+void Netlink::showvlans (std::span<const std::string> devices)
+{
+    std::unordered_map<int, std::vector<VlanRange>> vlans;
+    auto parse = [&](const nlmsghdr *hdr, Link &link) {
+        parseLink(hdr, link);
+        std::vector<VlanRange> &ranges = vlans[link.index];
+        ranges.clear();
+        parseVlans(hdr, ranges);
+    };
+
+    DumpRequest request (RTEXT_FILTER_BRVLAN_COMPRESSED);
+    request.family().ifi_family = AF_BRIDGE;
+    std::vector<Link> results;
+    dumpLinks(request, results, parse);
+    storeLinks(results);
+
+    Output out;
+    Stats::Timer timer (Stats::Phase::Format);
+    out.put("port\tvlan ids\n");
+
+    if (devices.empty())
+        for (const Link &link : results)
+            printVlans(out, link.name, vlans[link.index]);
+
+    for (const std::string &device : devices) {
+        if (const Link *link = _topology.find(device))
+            printVlans(out, link->name, vlans[link->index]);
+        else if (lookup(device))
+            out.print("device {} is not a bridge port!\n", device);
+        else
+            out.print("device {} does not exist!\n", device);
+    }
+}
+
+void Netlink::parseVlans (const nlmsghdr *hdr,
+                          std::vector<VlanRange> &vlans) const
+{
+    const rtattr *tb [IFLA_MAX + 1] = {};
+    parseAttrs(hdr, tb);
+    if (! tb[IFLA_AF_SPEC])
+        return;
+
+    uint16_t first = 0;
+    auto visit = [&](unsigned short type, const rtattr *attr) {
+        if (type != IFLA_BRIDGE_VLAN_INFO)
+            return;
+
+        const bridge_vlan_info *info =
+            reinterpret_cast<const bridge_vlan_info *>(RTA_DATA(attr));
+        if (info->flags & BRIDGE_VLAN_INFO_RANGE_BEGIN) {
+            first = info->vid;
+            return;
+        }
+        vlans.push_back({
+            .first = info->flags & BRIDGE_VLAN_INFO_RANGE_END ? first
+                                                              : info->vid,
+            .last = info->vid,
+            .flags = static_cast<uint16_t>(
+                info->flags &
+                (BRIDGE_VLAN_INFO_PVID | BRIDGE_VLAN_INFO_UNTAGGED))});
+    };
+
+    attributeParser(reinterpret_cast<const rtattr *>(
+                        RTA_DATA(tb[IFLA_AF_SPEC])),
+                    RTA_PAYLOAD(tb[IFLA_AF_SPEC]), visit);
+}
+
+void Netlink::addvlans (const std::string &device,
+                        std::span<const VlanRange> vlans)
+{
+    submitVlans(RTM_SETLINK, device, vlans);
+}
+
+void Netlink::delvlans (const std::string &device,
+                        std::span<const VlanRange> vlans)
+{
+    submitVlans(RTM_DELLINK, device, vlans);
+}
+
+void Netlink::submitVlans (uint16_t type, const std::string &device,
+                           std::span<const VlanRange> vlans)
+{
+    const auto dev = resolve(device);
+    if (! dev)
+        throw NetlinkError(ENODEV,
+            std::format("interface {} does not exist!", device));
+
+    // All the ranges go in one message whatever their number
+    auto build = [&](auto &request) {
+        request.family().ifi_family = AF_BRIDGE;
+        request.family().ifi_index = dev->index;
+
+        auto spec = request.template nest<Message::BridgeSpec>();
+        // VLANs of the bridge itself rather than of a port
+        if (dev->isBridge())
+            spec.template put<Message::BridgeFlags>(BRIDGE_FLAGS_SELF);
+
+        for (const VlanRange &range : vlans) {
+            if (range.first == range.last) {
+                spec.template put<Message::VlanInfo>(
+                    {.flags = range.flags, .vid = range.first});
+                continue;
+            }
+            spec.template put<Message::VlanInfo>(
+                {.flags = static_cast<uint16_t>(
+                     range.flags | BRIDGE_VLAN_INFO_RANGE_BEGIN),
+                 .vid = range.first});
+            spec.template put<Message::VlanInfo>(
+                {.flags = static_cast<uint16_t>(
+                     range.flags | BRIDGE_VLAN_INFO_RANGE_END),
+                 .vid = range.last});
         }
     };
 
-    talkWithKernel(request, nullptr, headerHandler);
+    auto errHandler = [&, type](nlmsgerr *err) {
+        if (err->error)
+            throw NetlinkError(-err->error,
+                std::format("can't {} vlans of {}: {}",
+                            type == RTM_SETLINK ? "add" : "delete",
+                            device, std::strerror(-err->error)));
+    };
+
+    // A batch takes the space of the entries put rather than of every VLAN
+    size_t entries = 0;
+    for (const VlanRange &range : vlans)
+        entries += range.first == range.last ? 1 : 2;
+
+    submit<Message::SetVlans>(type, NLM_F_REQUEST | NLM_F_ACK,
+                              build, errHandler,
+                              Message::setVlansSpace(entries));
+}
+
+Netlink::DumpRequest::DumpRequest (uint32_t extMask) :
+    Message::Request<Message::DumpLinks>(RTM_GETLINK,
+                                         NLM_F_REQUEST | NLM_F_ACK |
+                                             NLM_F_DUMP)
+{
+    put<Message::ExtMask>(extMask);
+}
+
+bool Netlink::dumpLinks (DumpRequest &request,
+                         std::vector<Link> &results,
+                         const LinkParser &parse)
+{
+    bool accepted = true;
+
+    // Kernel with strict checks replies with an error to unknown filters
+    auto errHandler = [&](nlmsgerr *err) {
+        if (err->error == -EINVAL || err->error == -EOPNOTSUPP)
+            accepted = false;
+        else if (err->error)
+            throw NetlinkError(-err->error,
+                std::format("Failed to dump links: {}",
+                            std::strerror(-err->error)));
+    };
 
-    // Separate flies from cutlets
-    for (Something &wtf : results) {
-        if (static_cast<Bridge>(wtf).isSane())
-            _bridges[wtf.name] = static_cast<Bridge>(wtf);
-        else if (static_cast<Device>(wtf).isSane())
-            _devices[wtf.name] = static_cast<Device>(wtf);
+    auto parseOne = [&](nlmsghdr *hdr) -> Link & {
+        Link &link = results.emplace_back();
+        if (parse)
+            parse(hdr, link);
         else
+            parseLink(hdr, link);
+        return link;
+    };
+
+    // Handler to parse Netlink messages
+    auto headerHandler = [&](nlmsghdr *hdr){
+        if (hdr->nlmsg_type == RTM_NEWLINK)
+            parseOne(hdr);
+    };
+
+    // The pipeline reuses its buffers so only the names are kept
+    auto internHandler = [&](nlmsghdr *hdr){
+        if (hdr->nlmsg_type == RTM_NEWLINK) {
+            Link &link = parseOne(hdr);
+            link.name = _arena.intern(link.name);
+        }
+    };
+
+    // The link records refer to the messages so keep them
+    // Redo the dump if the links have changed while it was running
+    for (int attempt = 0; attempt < maxDumpRestarts; ++attempt) {
+        results.clear();
+        const ErrorCode errorCode =
+            pipelined() ? pipelineWithKernel(request.header(), errHandler,
+                                             internHandler)
+                        : talkWithKernel(request.header(), errHandler,
+                                         headerHandler, &_arena);
+        if (errorCode != ErrorCode::DumpInconsistent)
+            break;
+        Stats::add(Stats::Counter::DumpRestarts);
+    }
+    return accepted;
+}
+
+void Netlink::storeLinks (std::vector<Link> &results)
+{
+    Stats::Timer timer (Stats::Phase::Topology);
+
+    for (Link &wtf : results) {
+        if (! wtf.isSane())
             throw std::runtime_error(
                 std::format("Got something insane "
                             "{}: {}: {} STP {} {}",
-                            wtf.index, wtf.name, wtf.operstate, wtf.stp_state,
-                            wtf.bridge_id));
+                            wtf.index, wtf.name, operstateName(wtf.operstate),
+                            wtf.stp_state, formatBridgeId(wtf.bridge_id)));
+        _topology.insert(wtf);
+    }
+}
+
+void Netlink::parseLink (const nlmsghdr *hdr, Link &link,
+                         BridgeStp *bridgeStp, PortStp *portStp)
+{
+    const ifinfomsg *ifi = reinterpret_cast<const ifinfomsg *>(NLMSG_DATA(hdr));
+    link.index = ifi->ifi_index;
+
+    const rtattr *tb [IFLA_MAX + 1] = {};
+    parseAttrs(hdr, tb);
+
+    if (tb[IFLA_IFNAME])
+        link.name = readAttr<std::string_view>(tb[IFLA_IFNAME]);
+    if (tb[IFLA_MASTER])
+        link.master = readAttr<uint32_t>(tb[IFLA_MASTER]);
+    if (tb[IFLA_OPERSTATE])
+        link.operstate = getOperstate(tb[IFLA_OPERSTATE]);
+    // Only AF_BRIDGE messages of ports carry it
+    if (portStp && tb[IFLA_PROTINFO])
+        parsePortStp(tb[IFLA_PROTINFO], *portStp);
+    if (! tb[IFLA_LINKINFO])
+        return;
+
+    // Bridge properties are in IFLA_LINKINFO -> IFLA_INFO_DATA
+    const rtattr *info [IFLA_INFO_MAX + 1] = {};
+    parseNestedAttrs(tb[IFLA_LINKINFO], info);
+
+    if (! info[IFLA_INFO_KIND] || ! info[IFLA_INFO_DATA] ||
+        readAttr<std::string_view>(info[IFLA_INFO_KIND]) != "bridge")
+        return;
+
+    link.bridge = true;
+
+    const rtattr *br [IFLA_BR_MAX + 1] = {};
+    parseNestedAttrs(info[IFLA_INFO_DATA], br);
+
+    if (br[IFLA_BR_BRIDGE_ID])
+        link.bridge_id = getBridgeId(br[IFLA_BR_BRIDGE_ID]);
+    if (br[IFLA_BR_STP_STATE])
+        link.stp_state = readAttr<uint32_t>(br[IFLA_BR_STP_STATE]);
+    if (bridgeStp)
+        parseBridgeStp(info[IFLA_INFO_DATA], *bridgeStp);
+}
+
+/* The kernel keeps times in clock_t, which is always in hundredths of a
+ * second for the user space */
+void Netlink::parseBridgeStp (const rtattr *data, BridgeStp &stp) const
+{
+    const rtattr *br [IFLA_BR_MAX + 1] = {};
+    parseNestedAttrs(data, br);
+
+    if (br[IFLA_BR_ROOT_ID])
+        stp.rootId = getBridgeId(br[IFLA_BR_ROOT_ID]);
+    if (br[IFLA_BR_ROOT_PORT])
+        stp.rootPort = readAttr<uint16_t>(br[IFLA_BR_ROOT_PORT]);
+    if (br[IFLA_BR_ROOT_PATH_COST])
+        stp.rootPathCost = readAttr<uint32_t>(br[IFLA_BR_ROOT_PATH_COST]);
+
+    if (br[IFLA_BR_MAX_AGE])
+        stp.maxAge = readAttr<uint32_t>(br[IFLA_BR_MAX_AGE]);
+    if (br[IFLA_BR_HELLO_TIME])
+        stp.helloTime = readAttr<uint32_t>(br[IFLA_BR_HELLO_TIME]);
+    if (br[IFLA_BR_FORWARD_DELAY])
+        stp.forwardDelay = readAttr<uint32_t>(br[IFLA_BR_FORWARD_DELAY]);
+    if (br[IFLA_BR_AGEING_TIME])
+        stp.ageingTime = readAttr<uint32_t>(br[IFLA_BR_AGEING_TIME]);
+
+    if (br[IFLA_BR_HELLO_TIMER])
+        stp.helloTimer = readAttr<uint64_t>(br[IFLA_BR_HELLO_TIMER]);
+    if (br[IFLA_BR_TCN_TIMER])
+        stp.tcnTimer = readAttr<uint64_t>(br[IFLA_BR_TCN_TIMER]);
+    if (br[IFLA_BR_TOPOLOGY_CHANGE_TIMER])
+        stp.topologyChangeTimer =
+            readAttr<uint64_t>(br[IFLA_BR_TOPOLOGY_CHANGE_TIMER]);
+    if (br[IFLA_BR_GC_TIMER])
+        stp.gcTimer = readAttr<uint64_t>(br[IFLA_BR_GC_TIMER]);
+
+    if (br[IFLA_BR_TOPOLOGY_CHANGE])
+        stp.topologyChange = readAttr<uint8_t>(br[IFLA_BR_TOPOLOGY_CHANGE]);
+    if (br[IFLA_BR_TOPOLOGY_CHANGE_DETECTED])
+        stp.topologyChangeDetected =
+            readAttr<uint8_t>(br[IFLA_BR_TOPOLOGY_CHANGE_DETECTED]);
+}
+
+void Netlink::parsePortStp (const rtattr *protinfo, PortStp &stp) const
+{
+    const rtattr *port [IFLA_BRPORT_MAX + 1] = {};
+    parseNestedAttrs(protinfo, port);
+
+    if (port[IFLA_BRPORT_STATE])
+        stp.state = PortState(readAttr<uint8_t>(port[IFLA_BRPORT_STATE]));
+    if (port[IFLA_BRPORT_PRIORITY])
+        stp.priority = readAttr<uint16_t>(port[IFLA_BRPORT_PRIORITY]);
+    if (port[IFLA_BRPORT_COST])
+        stp.cost = readAttr<uint32_t>(port[IFLA_BRPORT_COST]);
+    if (port[IFLA_BRPORT_ID])
+        stp.id = readAttr<uint16_t>(port[IFLA_BRPORT_ID]);
+    if (port[IFLA_BRPORT_NO])
+        stp.number = readAttr<uint16_t>(port[IFLA_BRPORT_NO]);
+
+    if (port[IFLA_BRPORT_ROOT_ID])
+        stp.designatedRoot = getBridgeId(port[IFLA_BRPORT_ROOT_ID]);
+    if (port[IFLA_BRPORT_BRIDGE_ID])
+        stp.designatedBridge = getBridgeId(port[IFLA_BRPORT_BRIDGE_ID]);
+    if (port[IFLA_BRPORT_DESIGNATED_PORT])
+        stp.designatedPort =
+            readAttr<uint16_t>(port[IFLA_BRPORT_DESIGNATED_PORT]);
+    if (port[IFLA_BRPORT_DESIGNATED_COST])
+        stp.designatedCost =
+            readAttr<uint32_t>(port[IFLA_BRPORT_DESIGNATED_COST]);
+
+    if (port[IFLA_BRPORT_MESSAGE_AGE_TIMER])
+        stp.messageAgeTimer =
+            readAttr<uint64_t>(port[IFLA_BRPORT_MESSAGE_AGE_TIMER]);
+    if (port[IFLA_BRPORT_FORWARD_DELAY_TIMER])
+        stp.forwardDelayTimer =
+            readAttr<uint64_t>(port[IFLA_BRPORT_FORWARD_DELAY_TIMER]);
+    if (port[IFLA_BRPORT_HOLD_TIMER])
+        stp.holdTimer = readAttr<uint64_t>(port[IFLA_BRPORT_HOLD_TIMER]);
+
+    auto flag = [&](int type) {
+        return port[type] && readAttr<uint8_t>(port[type]);
+    };
+    stp.configPending = flag(IFLA_BRPORT_CONFIG_PENDING);
+    stp.topologyChangeAck = flag(IFLA_BRPORT_TOPOLOGY_CHANGE_ACK);
+    stp.hairpin = flag(IFLA_BRPORT_MODE);
+    stp.bpduGuard = flag(IFLA_BRPORT_GUARD);
+    stp.rootBlock = flag(IFLA_BRPORT_PROTECT);
+    stp.fastLeave = flag(IFLA_BRPORT_FAST_LEAVE);
+    stp.learning = flag(IFLA_BRPORT_LEARNING);
+    stp.flood = flag(IFLA_BRPORT_UNICAST_FLOOD);
+}
+
+/* The subscription comes first so nothing happening during the dump is
+ * missed. Notifications that duplicate the dump are harmless */
+void Netlink::startEvents ()
+{
+    events();
+    _topology.clear();
+    getDevicesAndBridges();
+}
+
+void Netlink::becomeResident ()
+{
+    startEvents();
+    _resident = true;
+    _eventsApplied = 0;
+}
+
+int Netlink::eventsFd ()
+{
+    return events().fd();
+}
+
+void Netlink::applyEvents ()
+{
+    pollfd pending {.fd = eventsFd(), .events = POLLIN};
+    auto ignore = [](const Link *, const Link *) {};
+
+    while (poll(&pending, 1, 0) > 0) {
+        handleEvents(ignore);
+        ++_eventsApplied;
     }
 
-    // Trace the relations
-    for (Something &wtf : results) {
-        if (wtf.master) {
-            for (auto &br : _bridges)
-                if (wtf.master == br.second.index)
-                    _relations.insert({br.first, wtf.name});
+    // Nothing points into the arena between the commands
+    if (_eventsApplied > maxResidentEvents)
+        reload();
+}
+
+void Netlink::reload ()
+{
+    _topology.clear();
+    _arena.clear();
+    getDevicesAndBridges();
+    _eventsApplied = 0;
+}
+
+void Netlink::handleEvents (ChangeCallback onChange)
+{
+    std::span<uint8_t> data;
+
+    try {
+        data = events().receive();
+    } catch (NetlinkSession::Overrun &) {
+        return resync(onChange);
+    }
+
+    int bytesReceived = data.size();
+    nlmsghdr *hdr = reinterpret_cast<nlmsghdr *>(data.data());
+
+    for (; NLMSG_OK(hdr, bytesReceived); hdr = NLMSG_NEXT(hdr, bytesReceived)) {
+        if (hdr->nlmsg_type != RTM_NEWLINK && hdr->nlmsg_type != RTM_DELLINK)
+            continue;
+
+        // Bridge port notifications (AF_BRIDGE) duplicate the generic ones
+        const ifinfomsg *ifi =
+            reinterpret_cast<const ifinfomsg *>(NLMSG_DATA(hdr));
+        if (ifi->ifi_family != AF_UNSPEC)
+            continue;
+
+        Link link;
+        parseLink(hdr, link);
+
+        const Link *known = _topology.find(link.index);
+        const std::optional<Link> before =
+            known ? std::optional(*known) : std::nullopt;
+
+        if (hdr->nlmsg_type == RTM_DELLINK) {
+            // The ports leave while the bridge is still known by name
+            if (before && before->isBridge())
+                detachPorts(link.index, onChange);
+            _topology.erase(link.index);
+            onChange(before ? &*before : nullptr, nullptr);
+            continue;
         }
+
+        // The name points into the receive buffer so keep it
+        if (const Link *same = _topology.find(link.name))
+            link.name = same->name;
+        else
+            link.name = _arena.intern(link.name);
+
+        if (! link.isSane())
+            continue;
+
+        _topology.insert(link);
+        onChange(before ? &*before : nullptr, _topology.find(link.index));
     }
 }
 
+void Netlink::detachPorts (int bridge, ChangeCallback onChange)
+{
+    // Copied as the ports of the bridge change under the loop
+    const std::span<const int> current = _topology.ports(bridge);
+    const std::vector<int> ports (current.begin(), current.end());
+
+    for (int index : ports) {
+        const Link before = *_topology.find(index);
+        _topology.setMaster(index, 0);
+        onChange(&before, _topology.find(index));
+    }
+}
+
+void Netlink::resync (ChangeCallback onChange)
+{
+    /* A daemon reports no changes, so the arena goes with the old topology
+     * rather than growing by a dump every overrun */
+    if (_resident)
+        return reload();
+
+    // The arena keeps the names the old topology points to
+    const Topology old = std::move(_topology);
+    _topology.clear();
+    getDevicesAndBridges();
+
+    // Bridges gone meanwhile are named by the old topology
+    _previous = &old;
+    for (const Link &link : old.links())
+        if (link.index)
+            onChange(&link, _topology.find(link.index));
+
+    for (const Link &link : _topology.links())
+        if (link.index && ! old.find(link.index))
+            onChange(nullptr, &link);
+    _previous = nullptr;
+}
+
+void Netlink::printChange (const Link *before, const Link *after)
+{
+    auto name = [this](uint32_t index) {
+        const Link *link = _topology.find(index);
+        if (! link && _previous)
+            link = _previous->find(index);
+        return link ? std::string(link->name) : std::to_string(index);
+    };
+
+    const Link *link = after ? after : before;
+    const bool wasBridge = before && before->isBridge();
+    const bool isBridge = after && after->isBridge();
+
+    if (! wasBridge && isBridge)
+        std::cout << std::format("bridge {} created", link->name) << std::endl;
+    else if (wasBridge && ! isBridge)
+        std::cout << std::format("bridge {} deleted", link->name) << std::endl;
+    else if (wasBridge && isBridge) {
+        if (before->stp_state != after->stp_state)
+            std::cout << std::format("bridge {}: STP {}", link->name,
+                                     after->stp_state ? "enabled" : "disabled")
+                      << std::endl;
+        if (before->operstate != after->operstate)
+            std::cout << std::format("bridge {} is {}", link->name,
+                                     operstateName(after->operstate))
+                      << std::endl;
+    }
+
+    const uint32_t wasMaster = before ? before->master : 0;
+    const uint32_t isMaster = after ? after->master : 0;
+
+    if (wasMaster == isMaster)
+        return;
+    if (wasMaster)
+        std::cout << std::format("{}: port {} removed",
+                                 name(wasMaster), link->name) << std::endl;
+    if (isMaster)
+        std::cout << std::format("{}: port {} added",
+                                 name(isMaster), link->name) << std::endl;
+}
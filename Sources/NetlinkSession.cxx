@@ -0,0 +1,68 @@
+#include "NetlinkSession.hxx"
+#include "KernelTransport.hxx"
+
+#include <algorithm>
+#include <unistd.h>
+
+NetlinkSession::NetlinkSession () :
+    NetlinkSession(std::make_unique<KernelTransport>())
+{}
+
+NetlinkSession::NetlinkSession (std::unique_ptr<Transport> transport) :
+    _transport(std::move(transport)),
+    _rcvBuffer(std::max<size_t>(DefaultBufferSize, getpagesize())),
+    _seq(0)
+{}
+
+void NetlinkSession::subscribe (unsigned group)
+{
+    _transport->subscribe(group);
+}
+
+uint32_t NetlinkSession::stamp (nlmsghdr &hdr)
+{
+    return hdr.nlmsg_seq = ++_seq;
+}
+
+void NetlinkSession::send (std::span<iovec> messages)
+{
+    _transport->send(messages);
+}
+
+/* Every datagram is sized with a peek first so messages bigger than the
+ * buffer are received instead of being truncated */
+
+std::span<uint8_t> NetlinkSession::receive ()
+{
+    return receive(_rcvBuffer);
+}
+
+std::span<uint8_t> NetlinkSession::receive (std::vector<uint8_t> &buffer)
+{
+    const size_t size = _transport->peek();
+    if (size > buffer.size())
+        buffer.resize(size);
+
+    return _transport->receive(buffer);
+}
+
+std::span<uint8_t> NetlinkSession::receive (Arena &keep)
+{
+    // Offer the kernel no more than the session buffer unless the datagram
+    // is bigger: it remembers the largest one and makes the next ones as big
+    const size_t size = std::max(_transport->peek(), bufferSize());
+    std::span<uint8_t> buffer = keep.reserve(size).first(size);
+
+    std::span<uint8_t> data = _transport->receive(buffer);
+    // Replayed datagrams aren't copied, they stay mapped with the session
+    if (data.data() == buffer.data())
+        keep.commit(data.size());
+    return data;
+}
+
+bool NetlinkSession::isReply (const nlmsghdr *hdr,
+                              uint32_t first, uint32_t last) const
+{
+    return hdr->nlmsg_pid == portId() &&
+           hdr->nlmsg_seq >= first && hdr->nlmsg_seq <= last;
+}
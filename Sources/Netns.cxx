@@ -0,0 +1,48 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+
+#include "FileDescriptor.hxx"
+#include "Netns.hxx"
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> Netns::list ()
+{
+    std::vector<std::string> names;
+    std::error_code error;
+
+    for (const auto &entry : fs::directory_iterator(RunDir, error))
+        names.push_back(entry.path().filename().string());
+
+    // No namespaces were ever added if there is no directory
+    if (error && error != std::errc::no_such_file_or_directory)
+        throw std::runtime_error(std::format("Failed to list {}: {}",
+                                             RunDir, error.message()));
+
+    std::ranges::sort(names);
+    return names;
+}
+
+void Netns::enter (const std::string &name)
+{
+    const std::string path = name.find('/') == std::string::npos
+                                 ? std::format("{}/{}", RunDir, name)
+                                 : name;
+
+    FileDescriptor ns (open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (! ns)
+        throw std::runtime_error(std::format("Cannot open network namespace "
+                                             "{}: {}", name,
+                                             std::strerror(errno)));
+
+    if (setns(ns.fd(), CLONE_NEWNET) < 0)
+        throw std::runtime_error(std::format("Failed to enter network "
+                                             "namespace {}: {}", name,
+                                             std::strerror(errno)));
+}
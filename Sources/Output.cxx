@@ -0,0 +1,43 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "Output.hxx"
+#include "Stats.hxx"
+
+Output::Output (int fd) :
+    _fd(fd)
+{
+    _buffer.reserve(FlushSize);
+    // Whatever went through std::cout must go first
+    std::cout.flush();
+}
+
+Output::~Output ()
+{
+    try {
+        flush();
+    } catch (std::exception &) {
+        // Nowhere to report it
+    }
+}
+
+void Output::flush ()
+{
+    std::string_view left = _buffer;
+    Stats::Timer timer (Stats::Phase::Format);
+
+    while (! left.empty()) {
+        const ssize_t written = write(_fd, left.data(), left.size());
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            _buffer.clear();
+            throw std::runtime_error(std::format("Failed to write output: {}",
+                                                 std::strerror(errno)));
+        }
+        left.remove_prefix(written);
+    }
+    _buffer.clear();
+}
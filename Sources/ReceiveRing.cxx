@@ -0,0 +1,64 @@
+#include "ReceiveRing.hxx"
+
+ReceiveRing::ReceiveRing (size_t slots, size_t bufferSize) :
+    _buffers(slots, std::vector<uint8_t>(bufferSize)),
+    _data(slots)
+{}
+
+std::vector<uint8_t> * ReceiveRing::acquire ()
+{
+    std::unique_lock lock (_mutex);
+    _drained.wait(lock, [this] {
+        return _closed || _acquired - _released < _buffers.size();
+    });
+    if (_closed)
+        return nullptr;
+    return &_buffers[_acquired++ % _buffers.size()];
+}
+
+void ReceiveRing::publish (std::span<uint8_t> data)
+{
+    {
+        std::lock_guard lock (_mutex);
+        _data[_published++ % _data.size()] = data;
+    }
+    _filled.notify_one();
+}
+
+void ReceiveRing::fail (std::exception_ptr error)
+{
+    {
+        std::lock_guard lock (_mutex);
+        _error = error;
+    }
+    _filled.notify_one();
+}
+
+std::span<uint8_t> ReceiveRing::consume ()
+{
+    std::unique_lock lock (_mutex);
+    _filled.wait(lock, [this] { return _consumed < _published || _error; });
+
+    // Datagrams received before the failure go first
+    if (_consumed == _published)
+        std::rethrow_exception(_error);
+    return _data[_consumed++ % _data.size()];
+}
+
+void ReceiveRing::release ()
+{
+    {
+        std::lock_guard lock (_mutex);
+        ++_released;
+    }
+    _drained.notify_one();
+}
+
+void ReceiveRing::close ()
+{
+    {
+        std::lock_guard lock (_mutex);
+        _closed = true;
+    }
+    _drained.notify_one();
+}
@@ -0,0 +1,223 @@
+#include <cstring>
+
+#include "ShowPrinter.hxx"
+
+using namespace ShowBinary;
+
+std::unique_ptr<ShowPrinter> ShowPrinter::create (ShowFormat format,
+                                                  Output &out)
+{
+    switch (format) {
+    case ShowFormat::Json:
+        return std::make_unique<JsonPrinter>(out);
+    case ShowFormat::Binary:
+        return std::make_unique<BinaryPrinter>(out);
+    default:
+        return std::make_unique<TextPrinter>(out);
+    }
+}
+
+
+void TextPrinter::bridge (const Topology &topology, const Link &br)
+{
+    if (! _headerPrinted) {
+        _out.print("{}\t{}\t\t{}\t{}\n",
+                   "bridge name", "bridge id", "STP enabled", "interfaces");
+        _headerPrinted = true;
+    }
+    _out.print("{}\t\t{}\t{}\t\t", br.name, formatBridgeId(br.bridge_id),
+               br.stp_state ? "yes" : "no");
+
+    auto ports = topology.ports(br.index);
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (i)
+            _out.put(", ");
+        _out.put(topology.find(ports[i])->name);
+    }
+    _out.put("\n");
+}
+
+void TextPrinter::missing (std::string_view name)
+{
+    _out.print("bridge {} does not exist!\n", name);
+}
+
+void TextPrinter::notBridge (std::string_view name)
+{
+    _out.print("device {} is not a bridge!\n", name);
+}
+
+void TextPrinter::netns (std::string_view name)
+{
+    // Every namespace gets a table of its own
+    _out.print("{}netns: {}\n", _namespaces++ ? "\n" : "", name);
+    _headerPrinted = false;
+}
+
+void TextPrinter::error (std::string_view what)
+{
+    _out.print("{}\n", what);
+}
+
+
+/* {"bridges":[{...},...],"errors":[{"name":"...","error":"..."},...]}
+ * with a bridge per line. Bridges and errors get "netns" after netns() */
+
+void JsonPrinter::bridge (const Topology &topology, const Link &br)
+{
+    begin();
+    _out.put(_bridges++ ? ",\n{\"name\":" : "\n{\"name\":");
+    quoted(br.name);
+    netnsField(_netns);
+    _out.print(",\"ifindex\":{},\"bridge_id\":\"{}\",\"stp_enabled\":{},"
+               "\"operstate\":\"{}\",\"ports\":[",
+               br.index, formatBridgeId(br.bridge_id),
+               br.stp_state ? "true" : "false",
+               operstateName(br.operstate));
+
+    auto ports = topology.ports(br.index);
+    for (size_t i = 0; i < ports.size(); ++i) {
+        const Link *port = topology.find(ports[i]);
+        _out.put(i ? ",{\"name\":" : "{\"name\":");
+        quoted(port->name);
+        _out.print(",\"ifindex\":{},\"operstate\":\"{}\"}}",
+                   port->index, operstateName(port->operstate));
+    }
+    _out.put("]}");
+}
+
+void JsonPrinter::missing (std::string_view name)
+{
+    _errors.push_back({_netns, std::string(name), "does not exist"});
+}
+
+void JsonPrinter::notBridge (std::string_view name)
+{
+    _errors.push_back({_netns, std::string(name), "is not a bridge"});
+}
+
+void JsonPrinter::netns (std::string_view name)
+{
+    _netns = name;
+}
+
+void JsonPrinter::error (std::string_view what)
+{
+    _errors.push_back({_netns, "", std::string(what)});
+}
+
+void JsonPrinter::finish ()
+{
+    begin();
+    _out.put("],\"errors\":[");
+    for (size_t i = 0; i < _errors.size(); ++i) {
+        const Error &error = _errors[i];
+        _out.put(i ? ",{" : "{");
+        if (! error.name.empty()) {
+            _out.put("\"name\":");
+            quoted(error.name);
+            _out.put(",");
+        }
+        _out.put("\"error\":");
+        quoted(error.what);
+        netnsField(error.netns);
+        _out.put("}");
+    }
+    _out.put("]}\n");
+}
+
+void JsonPrinter::begin ()
+{
+    if (! _begun)
+        _out.put("{\"bridges\":[");
+    _begun = true;
+}
+
+void JsonPrinter::netnsField (std::string_view netns)
+{
+    if (netns.empty())
+        return;
+    _out.put(",\"netns\":");
+    quoted(netns);
+}
+
+void JsonPrinter::quoted (std::string_view str)
+{
+    _out.put("\"");
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            const char escaped [] = {'\\', c};
+            _out.put(std::string_view(escaped, sizeof(escaped)));
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+            _out.print("\\u{:04x}", static_cast<unsigned>(c));
+        else
+            _out.put(std::string_view(&c, 1));
+    }
+    _out.put("\"");
+}
+
+
+BinaryPrinter::BinaryPrinter (Output &out) :
+    ShowPrinter(out)
+{
+    _out.putBytes(Header {.magic = Magic, .version = Version});
+}
+
+void BinaryPrinter::bridge (const Topology &topology, const Link &br)
+{
+    auto ports = topology.ports(br.index);
+
+    // The size goes first so count it beforehand
+    size_t size = sizeof(BridgeRecord) + br.name.size();
+    for (int port : ports)
+        size += sizeof(PortRecord) + topology.find(port)->name.size();
+
+    _out.putBytes(RecordHeader {.size = static_cast<uint32_t>(size),
+                                .type = RecordType::Bridge});
+
+    BridgeRecord record {.ifindex = br.index,
+                         .ports = static_cast<uint32_t>(ports.size()),
+                         .stpEnabled = br.stp_state,
+                         .operstate = static_cast<uint8_t>(br.operstate),
+                         .nameLength = static_cast<uint16_t>(br.name.size())};
+    std::memcpy(record.bridgeId, br.bridge_id.data(), sizeof(record.bridgeId));
+    _out.putBytes(record);
+    _out.put(br.name);
+
+    for (int index : ports) {
+        const Link *port = topology.find(index);
+        _out.putBytes(PortRecord {
+            .ifindex = port->index,
+            .operstate = static_cast<uint8_t>(port->operstate),
+            .nameLength = static_cast<uint16_t>(port->name.size())});
+        _out.put(port->name);
+    }
+}
+
+void BinaryPrinter::missing (std::string_view name)
+{
+    nameRecord(RecordType::Missing, name);
+}
+
+void BinaryPrinter::notBridge (std::string_view name)
+{
+    nameRecord(RecordType::NotBridge, name);
+}
+
+void BinaryPrinter::netns (std::string_view name)
+{
+    nameRecord(RecordType::Netns, name);
+}
+
+void BinaryPrinter::error (std::string_view what)
+{
+    nameRecord(RecordType::Error, what);
+}
+
+void BinaryPrinter::nameRecord (RecordType type, std::string_view name)
+{
+    _out.putBytes(RecordHeader {.size = static_cast<uint32_t>(name.size()),
+                                .type = type});
+    _out.put(name);
+}
@@ -0,0 +1,70 @@
+#include "Stats.hxx"
+
+namespace
+{
+    constexpr std::string_view phaseNames [Stats::Phases] {
+        "socket_setup", "send", "receive_wait", "parse", "topology", "format"
+    };
+
+    constexpr std::string_view counterNames [Stats::Counters] {
+        "syscalls", "bytes_sent", "bytes_received", "messages", "attributes",
+        "dump_restarts", "allocations", "allocated_bytes"
+    };
+}
+
+void Stats::enable ()
+{
+    for (auto &value : _nanoseconds)
+        value = 0;
+    for (auto &value : _calls)
+        value = 0;
+    for (auto &value : _counters)
+        value = 0;
+
+    _enabledAt = Clock::now();
+    _enabled = true;
+}
+
+void Stats::time (Phase phase, Clock::duration duration)
+{
+    const size_t i = static_cast<size_t>(phase);
+    _nanoseconds[i].fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+        std::memory_order_relaxed);
+    _calls[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+Stats::Snapshot Stats::snapshot ()
+{
+    Snapshot snapshot {};
+    if (enabled())
+        snapshot.wallNanoseconds =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - _enabledAt).count();
+
+    for (size_t i = 0; i < Phases; ++i) {
+        snapshot.nanoseconds[i] = _nanoseconds[i];
+        snapshot.calls[i] = _calls[i];
+    }
+    for (size_t i = 0; i < Counters; ++i)
+        snapshot.counters[i] = _counters[i];
+    return snapshot;
+}
+
+/* {"wall_ns":N,"phases":{"send":{"ns":N,"calls":N},...},
+ *  "counters":{"syscalls":N,...}} */
+void Stats::print (Output &out)
+{
+    const Snapshot stats = snapshot();
+
+    out.print("{{\"wall_ns\":{},\"phases\":{{", stats.wallNanoseconds);
+    for (size_t i = 0; i < Phases; ++i)
+        out.print("{}\"{}\":{{\"ns\":{},\"calls\":{}}}", i ? "," : "",
+                  phaseNames[i], stats.nanoseconds[i], stats.calls[i]);
+
+    out.put("},\"counters\":{");
+    for (size_t i = 0; i < Counters; ++i)
+        out.print("{}\"{}\":{}", i ? "," : "",
+                  counterNames[i], stats.counters[i]);
+    out.put("}}\n");
+}
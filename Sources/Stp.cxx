@@ -0,0 +1,83 @@
+#include "Stp.hxx"
+
+namespace
+{
+    constexpr std::string_view portStateName (PortState state)
+    {
+        constexpr std::string_view names []
+            { "disabled", "listening", "learning", "forwarding", "blocking" };
+        return state <= PortState::Blocking
+                   ? names[static_cast<uint8_t>(state)] : "unknown";
+    }
+
+    // Hundredths of a second as seconds
+    std::string seconds (uint64_t centiseconds)
+    {
+        return std::format("{}.{:02}", centiseconds / 100, centiseconds % 100);
+    }
+
+    // Two columns of name and value
+    template <class L, class R>
+    void row (Output &out, std::string_view leftName, const L &left,
+              std::string_view rightName, const R &right)
+    {
+        out.print(" {:<22}{:>17}    {:<22}{:>12}\n",
+                  leftName, left, rightName, right);
+    }
+
+    void flag (Output &out, bool set, std::string_view name)
+    {
+        if (set)
+            out.print(" {}", name);
+    }
+}
+
+void printBridgeStp (Output &out, const Link &br, const BridgeStp &stp)
+{
+    out.print("{}\n", br.name);
+    row(out, "bridge id", formatBridgeId(br.bridge_id),
+        "stp", br.stp_state ? "enabled" : "disabled");
+    row(out, "designated root", formatBridgeId(stp.rootId),
+        "root port", stp.rootPort);
+    row(out, "path cost", stp.rootPathCost,
+        "ageing time", seconds(stp.ageingTime));
+    row(out, "max age", seconds(stp.maxAge),
+        "hello time", seconds(stp.helloTime));
+    row(out, "forward delay", seconds(stp.forwardDelay),
+        "gc timer", seconds(stp.gcTimer));
+    row(out, "hello timer", seconds(stp.helloTimer),
+        "tcn timer", seconds(stp.tcnTimer));
+    out.print(" {:<22}{:>17}\n", "topology change timer",
+              seconds(stp.topologyChangeTimer));
+
+    out.put(" flags                ");
+    flag(out, stp.topologyChange, "TOPOLOGY_CHANGE");
+    flag(out, stp.topologyChangeDetected, "TOPOLOGY_CHANGE_DETECTED");
+    out.put("\n\n");
+}
+
+void printPortStp (Output &out, const Link &port, const PortStp &stp)
+{
+    out.print("{} ({})\n", port.name, stp.number);
+    row(out, "port id", std::format("{:04x}", stp.id),
+        "state", portStateName(stp.state));
+    row(out, "priority", stp.priority, "path cost", stp.cost);
+    row(out, "designated root", formatBridgeId(stp.designatedRoot),
+        "message age timer", seconds(stp.messageAgeTimer));
+    row(out, "designated bridge", formatBridgeId(stp.designatedBridge),
+        "forward delay timer", seconds(stp.forwardDelayTimer));
+    row(out, "designated port", std::format("{:04x}", stp.designatedPort),
+        "hold timer", seconds(stp.holdTimer));
+    out.print(" {:<22}{:>17}\n", "designated cost", stp.designatedCost);
+
+    out.put(" flags                ");
+    flag(out, stp.configPending, "CONFIG_PENDING");
+    flag(out, stp.topologyChangeAck, "TOPOLOGY_CHANGE_ACK");
+    flag(out, stp.hairpin, "HAIRPIN");
+    flag(out, stp.bpduGuard, "BPDU_GUARD");
+    flag(out, stp.rootBlock, "ROOT_BLOCK");
+    flag(out, stp.fastLeave, "FAST_LEAVE");
+    flag(out, stp.learning, "LEARNING");
+    flag(out, stp.flood, "FLOOD");
+    out.put("\n\n");
+}
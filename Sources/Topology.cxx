@@ -0,0 +1,117 @@
+#include "Topology.hxx"
+
+#include <algorithm>
+#include <stdexcept>
+
+void Topology::clear ()
+{
+    _links.clear();
+    _names.clear();
+    _portsValid = false;
+}
+
+void Topology::insert (const Link &link)
+{
+    if (link.index <= 0)
+        throw std::runtime_error(
+            std::format("Can't store link {} with index {}",
+                        link.name, link.index));
+
+    // The name may have moved to another ifindex
+    if (auto it = _names.find(link.name);
+        it != _names.end() && it->second != link.index)
+        erase(it->second);
+
+    if (static_cast<size_t>(link.index) >= _links.size())
+        _links.resize(link.index + 1);
+
+    // The link may have been renamed
+    Link &slot = _links[link.index];
+    if (slot.index)
+        _names.erase(slot.name);
+
+    slot = link;
+    _names[slot.name] = slot.index;
+    _portsValid = false;
+}
+
+void Topology::erase (int index)
+{
+    if (! find(index))
+        return;
+
+    _names.erase(_links[index].name);
+    _links[index] = Link{};
+    _portsValid = false;
+}
+
+void Topology::setMaster (int index, uint32_t master)
+{
+    if (! find(index))
+        return;
+
+    _links[index].master = master;
+    _portsValid = false;
+}
+
+const Link * Topology::find (int index) const
+{
+    if (index <= 0 || static_cast<size_t>(index) >= _links.size() ||
+        ! _links[index].index)
+        return nullptr;
+    return &_links[index];
+}
+
+const Link * Topology::find (std::string_view name) const
+{
+    auto it = _names.find(name);
+    return it != _names.end() ? &_links[it->second] : nullptr;
+}
+
+std::span<const int> Topology::ports (int bridge) const
+{
+    if (! find(bridge))
+        return {};
+
+    if (! _portsValid)
+        buildPorts();
+
+    return std::span(_ports).subspan(_portsBegin[bridge],
+                                     _portsBegin[bridge + 1] -
+                                         _portsBegin[bridge]);
+}
+
+std::vector<int> Topology::bridges () const
+{
+    std::vector<int> result;
+    for (const Link &link : _links)
+        if (link.index && link.isBridge())
+            result.push_back(link.index);
+
+    std::ranges::sort(result, {}, [this](int index) {
+        return _links[index].name;
+    });
+    return result;
+}
+
+/* Counting sort of the links by their masters */
+void Topology::buildPorts () const
+{
+    _portsBegin.assign(_links.size() + 1, 0);
+
+    for (const Link &link : _links)
+        if (link.index && link.master && link.master < _links.size())
+            ++_portsBegin[link.master + 1];
+
+    for (size_t i = 1; i < _portsBegin.size(); ++i)
+        _portsBegin[i] += _portsBegin[i - 1];
+
+    _ports.resize(_portsBegin.back());
+    std::vector<uint32_t> next (_portsBegin.begin(), _portsBegin.end() - 1);
+
+    for (const Link &link : _links)
+        if (link.index && link.master && link.master < _links.size())
+            _ports[next[link.master]++] = link.index;
+
+    _portsValid = true;
+}
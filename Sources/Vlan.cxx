@@ -0,0 +1,76 @@
+#include <linux/if_bridge.h>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+#include "Vlan.hxx"
+
+namespace
+{
+    uint16_t parseVlanId (std::string_view text)
+    {
+        unsigned id = 0;
+        const auto [end, error] =
+            std::from_chars(text.data(), text.data() + text.size(), id);
+        if (error != std::errc() || end != text.data() + text.size() ||
+            id < 1 || id > MaxVlanId)
+            throw std::invalid_argument(
+                std::format("invalid vlan id \"{}\"", text));
+        return id;
+    }
+}
+
+std::vector<VlanRange> parseVlanRanges (std::string_view text,
+                                        uint16_t flags)
+{
+    std::vector<VlanRange> ranges;
+
+    while (true) {
+        const size_t comma = text.find(',');
+        const std::string_view item = text.substr(0, comma);
+        const size_t dash = item.find('-');
+
+        VlanRange range {.flags = flags};
+        range.first = parseVlanId(item.substr(0, dash));
+        range.last = dash == item.npos ? range.first
+                                       : parseVlanId(item.substr(dash + 1));
+        if (range.last < range.first)
+            throw std::invalid_argument(
+                std::format("invalid vlan range \"{}\"", item));
+        ranges.push_back(range);
+
+        if (comma == text.npos)
+            break;
+        text.remove_prefix(comma + 1);
+    }
+
+    std::ranges::sort(ranges, {}, &VlanRange::first);
+
+    std::vector<VlanRange> merged;
+    for (const VlanRange &range : ranges)
+        if (merged.size() && range.first <= merged.back().last + 1)
+            merged.back().last = std::max(merged.back().last, range.last);
+        else
+            merged.push_back(range);
+    return merged;
+}
+
+void printVlans (Output &out, std::string_view device,
+                 std::span<const VlanRange> vlans)
+{
+    out.print("{}", device);
+    if (vlans.empty())
+        out.put("\tNone\n");
+
+    for (const VlanRange &range : vlans) {
+        if (range.first == range.last)
+            out.print("\t{}", range.first);
+        else
+            out.print("\t{}-{}", range.first, range.last);
+        if (range.flags & BRIDGE_VLAN_INFO_PVID)
+            out.put(" PVID");
+        if (range.flags & BRIDGE_VLAN_INFO_UNTAGGED)
+            out.put(" Egress Untagged");
+        out.put("\n");
+    }
+}
@@ -1,8 +1,14 @@
 #include "_NetlinkImpl.hxx"
+#include "Capture.hxx"
+#include "KernelTransport.hxx"
 
-static const char * oper_states []
-    { "UNKNOWN", "NOTPRESENT", "DOWN", "LOWERLAYERDOWN",
-      "TESTING", "DORMANT", "UP"};
+#include <thread>
+#include <vector>
+
+#include "ReceiveRing.hxx"
+
+// Datagrams the receiver may get ahead of the parser
+static constexpr size_t pipelineDepth = 8;
 
 /* Netlink RTM_NEWLINK message has following structure:
  * +----------+-----------+--------+------+--------+------+-----+
@@ -16,176 +22,289 @@ static const char * oper_states []
  * Of course these nested attributes may also have a nested attributes and so on
  */
 
-/* The method creates a connection with kernel, sends a request,
- * checks the reply and calls handle for every nlmsghdr */
+/* The method sends a request over the session, checks the replies
+ * and calls handle for every nlmsghdr answering the request */
 
-ErrorCode _NetlinkImpl::talkWithKernel (Message::LinkRequest &rq,
+ErrorCode _NetlinkImpl::talkWithKernel (nlmsghdr &rq,
                                         ErrCallback errHandle,
-                                        MsgCallback msgHandle)
+                                        MsgCallback msgHandle,
+                                        Arena *keep)
 {
-    Socket sock;
-    sockaddr_nl address {.nl_family = AF_NETLINK};
-    iovec iov {.iov_base = &rq.hdr, .iov_len = rq.hdr.nlmsg_len};
-    msghdr msg {.msg_name = &address, .msg_namelen = sizeof(address),
-                .msg_iov = &iov, .msg_iovlen = 1};
+    NetlinkSession &ses = session();
+    const uint32_t seq = ses.stamp(rq);
+    iovec iov {.iov_base = &rq, .iov_len = rq.nlmsg_len};
     ErrorCode errorCode = ErrorCode::Success;
 
-    // Set receive buffer as recommended by docs.kernel.org
-    const size_t receiveBufferSize = std::max(8192, getpagesize());
-    unsigned char rcvBuffer [receiveBufferSize];
+    ses.send(std::span(&iov, 1));
 
-    setOptsMakeChecks(sock.fd(),
-                      &rq.buffer, sizeof(rq.buffer),
-                      &rcvBuffer, sizeof(rcvBuffer),
-                      &address, sizeof(address));
+    bool complete = false;
+    while (! complete) {
+        std::span<uint8_t> data = keep ? ses.receive(*keep) : ses.receive();
+        complete = handleReply(data, ses.portId(), seq,
+                               errHandle, msgHandle, errorCode);
+    }
+    return errorCode;
+}
+
+ErrorCode _NetlinkImpl::pipelineWithKernel (nlmsghdr &rq,
+                                            ErrCallback errHandle,
+                                            MsgCallback msgHandle)
+{
+    NetlinkSession &ses = session();
+    const uint32_t seq = ses.stamp(rq);
+    const uint32_t portId = ses.portId();
+    iovec iov {.iov_base = &rq, .iov_len = rq.nlmsg_len};
+    ErrorCode errorCode = ErrorCode::Success;
+    ReceiveRing ring (pipelineDepth, ses.bufferSize());
+
+    ses.send(std::span(&iov, 1));
+
+    // The receiver owns the session until it gets the end of the reply
+    std::jthread receiver ([&] {
+        try {
+            bool complete = false;
+            while (! complete) {
+                std::vector<uint8_t> *buffer = ring.acquire();
+                if (! buffer)
+                    return;
+                std::span<uint8_t> data = ses.receive(*buffer);
+                complete = isReplyEnd(data, portId, seq);
+                ring.publish(data);
+            }
+        } catch (...) {
+            ring.fail(std::current_exception());
+        }
+    });
+
+    try {
+        bool complete = false;
+        while (! complete) {
+            complete = handleReply(ring.consume(), portId, seq,
+                                   errHandle, msgHandle, errorCode);
+            ring.release();
+        }
+    } catch (...) {
+        ring.close();
+        throw;
+    }
+    return errorCode;
+}
 
+bool _NetlinkImpl::isReplyEnd (std::span<const uint8_t> data,
+                               uint32_t portId, uint32_t seq)
+{
+    int bytesLeft = data.size();
+    const nlmsghdr *hdr = reinterpret_cast<const nlmsghdr *>(data.data());
+
+    // The same conditions handleReply() stops on
+    while (NLMSG_OK(hdr, bytesLeft)) {
+        if (hdr->nlmsg_pid == portId && hdr->nlmsg_seq == seq &&
+                (hdr->nlmsg_type == NLMSG_DONE ||
+                 (hdr->nlmsg_type == NLMSG_ERROR &&
+                  static_cast<int>(hdr->nlmsg_len) == bytesLeft)))
+            return true;
+        hdr = NLMSG_NEXT(hdr, bytesLeft);
+    }
+    return false;
+}
 
-    // don't forget to add RTNL_HANDLE_F_STRICT_CHK
-    // it's stored in rth->flags in iproute2
+bool _NetlinkImpl::handleReply (std::span<uint8_t> data,
+                                uint32_t portId, uint32_t seq,
+                                const ErrCallback &errHandle,
+                                const MsgCallback &msgHandle,
+                                ErrorCode &errorCode)
+{
+    int bytesReceived = data.size();
+    nlmsghdr * hdr = reinterpret_cast<nlmsghdr *>(data.data());
+    Stats::Timer timer (Stats::Phase::Parse);
 
-    const int bytesSend = sendmsg(sock.fd(), &msg, 0);
-    if (bytesSend == -1)
-        throw std::runtime_error(std::format("Failed to sendmsg(), {}",
-                                             std::strerror(errno)));
-    else if (bytesSend != iov.iov_len)
-        throw std::runtime_error(std::format("Incorrect sendmsg() bytes: "
-                                             "sent {}, must be {}",
-                                             bytesSend, iov.iov_len));
+    while (NLMSG_OK(hdr, bytesReceived)) {
+        int messageSize = hdr->nlmsg_len;
+        int dataSize = messageSize - sizeof(*hdr);
 
-    iov.iov_base = &rcvBuffer;
+        // Check sizes
+        if (dataSize < 0 || messageSize > bytesReceived)
+            throw std::runtime_error(std::format("Invalid message size {}",
+                                                 messageSize));
 
-    bool complete = false;
-    while (! complete) {
-        iov.iov_len = sizeof(rcvBuffer);
-
-        int bytesReceived = recvmsg(sock.fd(), &msg, 0);
-        if (bytesReceived < 0) {
-            if (errno == EINTR || errno == EAGAIN)
-                continue;
-            throw std::runtime_error(std::format("Failed to recvmsg(), {}",
-                                                 std::strerror(errno)));
+        // Skip replies to someone else's requests
+        if (hdr->nlmsg_pid != portId || hdr->nlmsg_seq != seq) {
+            hdr = NLMSG_NEXT(hdr, bytesReceived);
+            continue;
         }
 
-        if (msg.msg_flags & MSG_TRUNC)
-            throw std::runtime_error("Truncated message");
+        Stats::add(Stats::Counter::Messages);
 
-        nlmsghdr * hdr = reinterpret_cast<nlmsghdr *>(rcvBuffer);
+        // If NLM_F_DUMP_INTR presend the dump must be reasked
+        if (hdr->nlmsg_flags & NLM_F_DUMP_INTR)
+            errorCode = ErrorCode::DumpInconsistent;
 
-        while (NLMSG_OK(hdr, bytesReceived)) {
-            int messageSize = hdr->nlmsg_len;
-            int dataSize = messageSize - sizeof(*hdr);
+        // Pass NLMSG_ERROR to handler if possible and go on
+        if (hdr->nlmsg_type == NLMSG_ERROR) {
+            if (errHandle != nullptr)
+                errHandle(reinterpret_cast<nlmsgerr *>(NLMSG_DATA(hdr)));
+            // Stop if no more data
+            if (messageSize == bytesReceived)
+                return true;
+        }
+        // Stop on NMLSG_DONE
+        else if (hdr->nlmsg_type == NLMSG_DONE) {
+            if (hdr->nlmsg_flags & NLM_F_MULTI)
+                return true;
+            else
+                throw std::runtime_error("Got NLMSG_DONE without "
+                                         "NLM_F_MULTI flag");
+        }
+        // Pass everything else to handler if possible
+        else if (msgHandle != nullptr)
+                msgHandle(hdr);
 
-            // Check sizes
-            if (dataSize < 0 || messageSize > bytesReceived)
-                throw std::runtime_error(std::format("Invalid message size {}",
-                                                     messageSize));
+        // Pick the next header
+        hdr = NLMSG_NEXT(hdr, bytesReceived);
+    }
+    return false;
+}
 
-            // If NLM_F_DUMP_INTR presend the dump must be reasked
-            if (hdr->nlmsg_flags & NLM_F_DUMP_INTR)
-                errorCode = ErrorCode::DumpInconsistent;
+/* The method sends the requests of the batch, a chunk per sendmsg(), and
+ * collects the ACKs after every chunk. The requests lay back to back so a
+ * chunk is a single piece. Each request gets its own sequence number so an
+ * ACK is passed to the handler of its request. A chunk ends at a number of
+ * requests or of bytes, whichever comes first, but holds at least one */
 
-            // Pass NLMSG_ERROR to handler if possible and go on
-            if (hdr->nlmsg_type == NLMSG_ERROR) {
-                if (errHandle != nullptr)
-                    errHandle(reinterpret_cast<nlmsgerr *>(NLMSG_DATA(hdr)));
-                // Stop if no more data
-                if (messageSize == bytesReceived)
-                    complete = true;
-            }
-            // Stop on NMLSG_DONE
-            else if (hdr->nlmsg_type == NLMSG_DONE) {
-                if (hdr->nlmsg_flags & NLM_F_MULTI) {
-                    complete = true;
-                    break;
-                } else
-                    throw std::runtime_error("Got NLMSG_DONE without "
-                                             "NLM_F_MULTI flag");
-            }
-            // Pass everything else to handler if possible
-            else if (msgHandle != nullptr)
-                    msgHandle(hdr);
+void _NetlinkImpl::talkWithKernel (Message::Batch &batch,
+                                   std::span<const ErrCallback> errHandles)
+{
+    // Not too many to keep all the ACKs of a chunk in the socket queue
+    constexpr size_t chunkSize = 128;
+    // The kernel rejects a sendmsg() longer than the send buffer with
+    // EMSGSIZE. It doubles the size it's given, so this is well below
+    const size_t chunkBytes = _socketOptions.sndBufSize;
+
+    NetlinkSession &ses = session();
+    std::vector<bool> acked (batch.size(), false);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ses.stamp(batch[i]);
+        batch[i].nlmsg_flags |= NLM_F_ACK;
+    }
 
-            // Pick the next header
-            hdr = NLMSG_NEXT(hdr, bytesReceived);
+    for (size_t first = 0, count; first < batch.size(); first += count) {
+        size_t bytes = NLMSG_ALIGN(batch[first].nlmsg_len);
+        for (count = 1; count < chunkSize && first + count < batch.size();
+             ++count) {
+            const size_t next = NLMSG_ALIGN(batch[first + count].nlmsg_len);
+            if (bytes + next > chunkBytes)
+                break;
+            bytes += next;
+        }
+
+        const uint32_t firstSeq = batch[first].nlmsg_seq;
+        const uint32_t lastSeq = batch[first + count - 1].nlmsg_seq;
+
+        std::span<uint8_t> chunk = batch.messages(first, count);
+        iovec iov {.iov_base = chunk.data(), .iov_len = chunk.size()};
+        ses.send(std::span(&iov, 1));
+
+        size_t outstanding = count;
+        while (outstanding) {
+            std::span<uint8_t> data = ses.receive();
+            int bytesReceived = data.size();
+
+            nlmsghdr * hdr = reinterpret_cast<nlmsghdr *>(data.data());
+
+            for (; NLMSG_OK(hdr, bytesReceived);
+                 hdr = NLMSG_NEXT(hdr, bytesReceived)) {
+                if (hdr->nlmsg_type != NLMSG_ERROR ||
+                    ! ses.isReply(hdr, firstSeq, lastSeq))
+                    continue;
+
+                // Match the ACK with its request
+                const size_t idx = first + hdr->nlmsg_seq - firstSeq;
+                if (acked[idx])
+                    continue;
+
+                acked[idx] = true;
+                --outstanding;
+                Stats::add(Stats::Counter::Messages);
+                if (errHandles[idx] != nullptr)
+                    errHandles[idx](
+                        reinterpret_cast<nlmsgerr *>(NLMSG_DATA(hdr)));
+            }
         }
     }
-    return errorCode;
 }
 
-std::string_view _NetlinkImpl::getOperstate(const rtattr * const attr) const
+void _NetlinkImpl::setSocketBuffers (int sndBufSize, int rcvBufSize)
 {
-    return oper_states[readAttr<uint8_t>(attr)];
+    _socketOptions = {.sndBufSize = sndBufSize, .rcvBufSize = rcvBufSize};
 }
 
-std::string _NetlinkImpl::getBridgeId(const rtattr * const attr) const
+void _NetlinkImpl::record (const std::string &path)
 {
-    ifla_bridge_id *id = readAttr<ifla_bridge_id*>(attr);
-    return std::format("{:02x}{:02x}.{:02x}{:02x}{:02x}{:02x}{:02x}{:02x}",
-                       id->prio[0], id->prio[1],
-                       id->addr[0], id->addr[1], id->addr[2],
-                       id->addr[3], id->addr[4], id->addr[5]);
+    _captureMode = CaptureMode::Record;
+    _capturePath = path;
+    // The links may point into the replies of the old session
+    _topology.clear();
+    _session.reset();
 }
 
-void _NetlinkImpl::parseAttrs(const nlmsghdr * const hdr, AttrCallback handle)
+void _NetlinkImpl::replay (const std::string &path)
 {
-    ifinfomsg * ifi = reinterpret_cast<ifinfomsg *>(NLMSG_DATA(hdr));
-    rtattr *attr = IFLA_RTA(ifi);
-    const int size = hdr->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
-    attributeParser(attr, size, handle);
+    _captureMode = CaptureMode::Replay;
+    _capturePath = path;
+    // The links may point into the replies of the old session
+    _topology.clear();
+    _session.reset();
 }
 
-void _NetlinkImpl::parseNestedAttrs (const rtattr *const parent,
-                                     AttrCallback handle)
+NetlinkSession & _NetlinkImpl::session ()
 {
-    rtattr *child = reinterpret_cast<rtattr *>(RTA_DATA(parent));
-    attributeParser(child, RTA_PAYLOAD(parent), handle);
+    if (! _session)
+        _session = std::make_unique<NetlinkSession>(openTransport());
+    return *_session;
 }
 
-void _NetlinkImpl::setOptsMakeChecks(const int &fd,
-                                     void * sndBuf, const size_t &sndBufSize,
-                                     void * rcvBuf, const size_t &rcvBufSize,
-                                     sockaddr_nl *addr, const size_t &addrSize)
+std::unique_ptr<Transport> _NetlinkImpl::openTransport ()
 {
-    int one = 1;
-
-    if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, sndBuf, sndBufSize) < 0)
-        throw std::runtime_error("Failed to set SO_SNDBUF");
-
-    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, rcvBuf, rcvBufSize) < 0)
-        throw std::runtime_error("Failed to set SO_RCVBUF");
-
-    if (setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK,
-                   &one, sizeof(one)) < 0)
-        throw std::runtime_error("Failed to set NETLINK_GET_STRICT_CHK");
-
-    if (bind(fd, reinterpret_cast<sockaddr *>(addr), addrSize) < 0)
-        throw std::runtime_error("Failed to bind socket");
-
-    size_t chkAddrSize = 0;
-
-    if (getsockname(fd, reinterpret_cast<sockaddr *>(addr),
-                    reinterpret_cast<socklen_t *>(&chkAddrSize)) < 0)
-        throw std::runtime_error("Failed to getsockname()");
+    switch (_captureMode) {
+    case CaptureMode::Record:
+        return std::make_unique<Recorder>(
+            std::make_unique<KernelTransport>(_socketOptions), _capturePath);
+    case CaptureMode::Replay:
+        return std::make_unique<Replayer>(_capturePath);
+    default:
+        return std::make_unique<KernelTransport>(_socketOptions);
+    }
+}
 
-    if (addrSize != chkAddrSize)
-        throw std::runtime_error(std::format("Got invalid address length {}",
-                                             chkAddrSize));
+NetlinkSession & _NetlinkImpl::events ()
+{
+    // Notifications would interleave with the session in the capture
+    if (_captureMode != CaptureMode::None)
+        throw std::runtime_error("Notifications can't be recorded or "
+                                 "replayed");
+
+    if (! _events) {
+        _events = std::make_unique<NetlinkSession>(
+            std::make_unique<KernelTransport>(_socketOptions));
+        _events->subscribe(RTNLGRP_LINK);
+    }
+    return *_events;
+}
 
-    if (addr->nl_family != AF_NETLINK)
-        throw std::runtime_error(std::format("Got invalid address family {}",
-                                             addr->nl_family));
+Operstate _NetlinkImpl::getOperstate(const rtattr * const attr) const
+{
+    const uint8_t state = readAttr<uint8_t>(attr);
+    return state <= static_cast<uint8_t>(Operstate::Up)
+               ? static_cast<Operstate>(state)
+               : Operstate::Unknown;
 }
 
-void _NetlinkImpl::attributeParser(const rtattr * attr, int size,
-                                   AttrCallback handle)
+BridgeId _NetlinkImpl::getBridgeId(const rtattr * const attr) const
 {
-    unsigned short type;
-    while (RTA_OK(attr, size)) {
-        type = attr->rta_type & ~NLA_F_NESTED;
-        handle(type, attr);
-        attr = RTA_NEXT(attr, size);
-    }
-    if (size)
-        throw std::runtime_error(
-            std::format("{} bytes left after attribute parse", size));
+    ifla_bridge_id *id = readAttr<ifla_bridge_id*>(attr);
+    BridgeId raw;
+    static_assert(sizeof(raw) == sizeof(*id));
+    std::memcpy(raw.data(), id, sizeof(raw));
+    return raw;
 }
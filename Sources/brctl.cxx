@@ -1,33 +1,140 @@
+#include <charconv>
 #include <iostream>
+#include <fstream>
 
+#include "Daemon.hxx"
 #include "Netlink.hxx"
+#include "Netns.hxx"
 #include "Fallback.hxx"
+#include "Stats.hxx"
 
 int main (int argc, const char * argv [])
 {
     std::vector<std::string> args (argv, argv + argc);
-    const bool useFallback = args.size() > 1 && args[1] == "-fb" ? true : false;
+    std::span<const std::string> argsToPass (args.data() + 1, args.size() - 1);
+    bool useFallback = false;
+    bool pipelined = false;
+    std::string batchFile;
+    std::string recordFile;
+    std::string replayFile;
+    std::string netns;
+    int rcvBufSize = 0;
+    bool stats = false;
+    bool daemon = false;
+    int status = 0;
 
-    if (args.size() == 1)
+    // Parse options preceding the command
+    while (argsToPass.size() && argsToPass.front().starts_with('-')) {
+        if (argsToPass.front() == "-fb")
+            useFallback = true;
+        else if (argsToPass.front() == "-pipeline")
+            pipelined = true;
+        else if (argsToPass.front() == "-stats")
+            stats = true;
+        else if (argsToPass.front() == "-daemon")
+            daemon = true;
+        else if (argsToPass.front() == "-batch" && argsToPass.size() > 1) {
+            batchFile = argsToPass[1];
+            argsToPass = argsToPass.last(argsToPass.size() - 1);
+        }
+        else if (argsToPass.front() == "-record" && argsToPass.size() > 1) {
+            recordFile = argsToPass[1];
+            argsToPass = argsToPass.last(argsToPass.size() - 1);
+        }
+        else if (argsToPass.front() == "-rcvbuf" && argsToPass.size() > 1) {
+            const std::string &value = argsToPass[1];
+            const char *end = value.data() + value.size();
+            const auto [last, error] =
+                std::from_chars(value.data(), end, rcvBufSize);
+            if (error != std::errc() || last != end || rcvBufSize <= 0) {
+                std::cout << std::format("-rcvbuf takes a positive number "
+                                         "of bytes, not \"{}\"", value)
+                          << std::endl;
+                Application::PrintHelp();
+                return 1;
+            }
+            argsToPass = argsToPass.last(argsToPass.size() - 1);
+        }
+        else if (argsToPass.front() == "-replay" && argsToPass.size() > 1) {
+            replayFile = argsToPass[1];
+            argsToPass = argsToPass.last(argsToPass.size() - 1);
+        }
+        else if (argsToPass.front() == "-n" && argsToPass.size() > 1) {
+            netns = argsToPass[1];
+            argsToPass = argsToPass.last(argsToPass.size() - 1);
+        }
+        else
+            break;
+        argsToPass = argsToPass.last(argsToPass.size() - 1);
+    }
+
+    if (argsToPass.empty() && batchFile.empty() && ! daemon)
         Application::PrintHelp();
 
     else {
-        const auto argsToPass = args.size() - (useFallback ? 2 : 1);
+        if (stats)
+            Stats::enable();
 
         try {
+            // Sockets are opened on the first request, so they go there
+            if (! netns.empty())
+                Netns::enter(netns);
+
+            // These are about this very process rather than the daemon
+            const bool local = useFallback || pipelined || stats ||
+                               rcvBufSize > 0 || ! recordFile.empty() ||
+                               ! replayFile.empty();
+
+            // Serves until it's killed
+            if (daemon && (local || ! batchFile.empty() ||
+                           ! argsToPass.empty()))
+                throw std::runtime_error(
+                    "-daemon takes no command and none of -fb, -pipeline, "
+                    "-stats, -rcvbuf, -record, -replay and -batch");
+            if (daemon)
+                Daemon().run();
+            if (batchFile.empty() && ! local && Daemon::serves(argsToPass))
+                if (const auto forwarded = Daemon::forward(argsToPass))
+                    return *forwarded;
+
             Netlink nl;
+            Fallback fb;
+            if (rcvBufSize > 0)
+                nl.setSocketBuffers(KernelTransport::Options().sndBufSize,
+                                    rcvBufSize);
+            nl.setPipelined(pipelined);
+            if (! recordFile.empty())
+                nl.record(recordFile);
+            if (! replayFile.empty())
+                nl.replay(replayFile);
             // Run Netlink version if Fallback flag not set and check() passes
-            if (! useFallback && nl.check())
-                nl.run(std::span(args.data(), args.size()).last(argsToPass));
             // Run ioctl/sysfs version otherwise
+            Application &app = ! useFallback && nl.check()
+                                   ? static_cast<Application &>(nl)
+                                   : static_cast<Application &>(fb);
+
+            if (batchFile.empty())
+                app.run(argsToPass);
+            else if (batchFile == "-")
+                app.runBatch(std::cin);
             else {
-                Fallback fb;
-                fb.run(std::span(args.data(), args.size()).last(argsToPass));
+                std::ifstream is (batchFile);
+                if (! is.good())
+                    throw std::runtime_error(
+                        std::format("Failed to open {}", batchFile));
+                app.runBatch(is);
             }
         } catch (std::exception &e) {
             std::cout << e.what() << std::endl;
+            status = 1;
+        }
+
+        // Apart from the output so both may be taken by programs
+        if (stats) {
+            Output err (STDERR_FILENO);
+            Stats::print(err);
         }
     }
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,171 @@
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "_NetlinkImpl.hxx"
+#include "Request.hxx"
+
+/* Batches of big requests must be split so no sendmsg() exceeds what the
+ * kernel takes from a socket with the default send buffer, and every
+ * request must still get its ACK. Nothing is sent to the kernel */
+
+/* Acknowledges every request sent, refusing a send the kernel would refuse */
+class AckingTransport : public Transport
+{
+public:
+    // What netlink_sendmsg() takes: the doubled buffer size less a bit
+    static constexpr size_t KernelLimit =
+        2 * KernelTransport::Options().sndBufSize - 32;
+    static constexpr uint32_t PortId = 4242;
+
+public:
+    virtual void send (std::span<iovec> messages) override {
+        for (const iovec &iov : messages) {
+            if (iov.iov_len > KernelLimit)
+                throw std::runtime_error(
+                    std::format("sendmsg() of {} bytes: {}", iov.iov_len,
+                                std::strerror(EMSGSIZE)));
+            Send &sent = sends.emplace_back(Send{.bytes = iov.iov_len});
+
+            const uint8_t *data = static_cast<const uint8_t *>(iov.iov_base);
+            int left = iov.iov_len;
+            for (auto *hdr = reinterpret_cast<const nlmsghdr *>(data);
+                 NLMSG_OK(hdr, left); hdr = NLMSG_NEXT(hdr, left)) {
+                ack(*hdr);
+                ++sent.requests;
+            }
+        }
+    }
+
+    virtual size_t peek () override {
+        if (_acks.empty())
+            throw std::runtime_error("Waiting for ACKs nobody sends");
+        return _acks.front().size();
+    }
+
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override {
+        const std::vector<uint8_t> datagram = std::move(_acks.front());
+        _acks.erase(_acks.begin());
+        std::memcpy(buffer.data(), datagram.data(), datagram.size());
+        return buffer.first(datagram.size());
+    }
+
+    virtual void subscribe (unsigned) override {}
+    virtual uint32_t portId () const override { return PortId; }
+
+public:
+    struct Send {
+        size_t bytes = 0;
+        size_t requests = 0;
+    };
+    // The sendmsg() calls in order
+    std::vector<Send> sends;
+
+private:
+    void ack (const nlmsghdr &request) {
+        std::vector<uint8_t> &datagram = _acks.emplace_back(
+            NLMSG_SPACE(sizeof(nlmsgerr)));
+        auto *hdr = reinterpret_cast<nlmsghdr *>(datagram.data());
+        *hdr = {.nlmsg_len = NLMSG_LENGTH(sizeof(nlmsgerr)),
+                .nlmsg_type = NLMSG_ERROR,
+                .nlmsg_flags = 0,
+                .nlmsg_seq = request.nlmsg_seq,
+                .nlmsg_pid = PortId};
+        auto *err = static_cast<nlmsgerr *>(NLMSG_DATA(hdr));
+        err->error = 0;
+        err->msg = request;
+    }
+
+private:
+    std::vector<std::vector<uint8_t>> _acks;
+};
+
+
+/* Sends the batch the way commitBatch() does over the transport above */
+class BatchSender : public _NetlinkImpl
+{
+public:
+    // Returns the sendmsg() calls made, throws if an ACK is missed
+    std::vector<AckingTransport::Send> send (Message::Batch &batch) {
+        size_t acked = 0;
+        std::vector<ErrCallback> errHandles (batch.size(),
+                                             [&acked](nlmsgerr *err) {
+            if (! err->error)
+                ++acked;
+        });
+
+        talkWithKernel(batch, errHandles);
+        if (acked != batch.size())
+            throw std::runtime_error(std::format("{} of {} requests acked",
+                                                 acked, batch.size()));
+        return _transport->sends;
+    }
+
+protected:
+    virtual std::unique_ptr<Transport> openTransport () override {
+        auto transport = std::make_unique<AckingTransport>();
+        _transport = transport.get();
+        return transport;
+    }
+
+private:
+    AckingTransport *_transport = nullptr;
+};
+
+
+// Batch of vlan requests with the number of VlanInfo entries of each
+static Message::Batch vlanBatch (std::span<const size_t> entries)
+{
+    Message::Batch batch;
+    for (size_t count : entries) {
+        auto request = batch.add<Message::SetVlans>(
+            RTM_SETLINK, NLM_F_REQUEST, Message::setVlansSpace(count));
+        request.family().ifi_family = AF_BRIDGE;
+        request.family().ifi_index = 1;
+        auto spec = request.nest<Message::BridgeSpec>();
+        for (size_t i = 0; i < count; ++i)
+            spec.put<Message::VlanInfo>(
+                {.flags = 0, .vid = static_cast<uint16_t>(i + 1)});
+    }
+    return batch;
+}
+
+static void check (std::string_view name, std::span<const size_t> entries)
+{
+    constexpr size_t budget = KernelTransport::Options().sndBufSize;
+    constexpr size_t maxRequests = 128;
+
+    Message::Batch batch = vlanBatch(entries);
+    const auto sends = BatchSender().send(batch);
+
+    // A request bigger than the budget goes alone
+    for (const AckingTransport::Send &sent : sends)
+        if ((sent.bytes > budget && sent.requests > 1) ||
+            sent.requests > maxRequests)
+            throw std::runtime_error(
+                std::format("{}: {} requests in {} bytes sent at once",
+                            name, sent.requests, sent.bytes));
+
+    std::cout << std::format("{}: {} requests in {} sendmsg()", name,
+                             entries.size(), sends.size())
+              << std::endl;
+}
+
+int main ()
+{
+    try {
+        // About 16 KiB each, a couple per chunk
+        check("half trunks", std::vector<size_t>(20, 2000));
+        // Every VLAN, one request is more than the budget and goes alone
+        check("full trunks", std::vector<size_t>(8, Message::MaxVlanInfos));
+        // Small ones still share a chunk up to the count limit
+        check("access ports", std::vector<size_t>(300, 1));
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DesiredTopology.hxx"
+
+/* Topology files of apply: comments and blank lines are skipped, a device
+ * may be named once whether as a bridge or as a port, and a malformed line
+ * is refused with its number */
+
+static std::vector<DesiredBridge> parse (std::string_view text)
+{
+    std::istringstream input {std::string(text)};
+    return parseDesiredTopology(input);
+}
+
+static void expect (bool condition, std::string_view what)
+{
+    if (! condition)
+        throw std::runtime_error(std::format("{} failed", what));
+}
+
+// Check the text is refused with the message given
+static void refused (std::string_view text, std::string_view message)
+{
+    try {
+        parse(text);
+    } catch (std::runtime_error &e) {
+        if (e.what() == message)
+            return;
+        throw std::runtime_error(std::format("\"{}\" refused with \"{}\", "
+                                             "expected \"{}\"", text,
+                                             e.what(), message));
+    }
+    throw std::runtime_error(std::format("\"{}\" isn't refused", text));
+}
+
+int main ()
+{
+    try {
+        const std::vector<DesiredBridge> bridges = parse(
+            "# bridges of the host\n"
+            "\n"
+            "bridge br0 stp on ports eth0 eth1   # uplinks\n"
+            "  bridge   br1\tports eth2\n"
+            "bridge br2 stp off\n"
+            "bridge br3 ports\n");
+
+        expect(bridges.size() == 4, "bridge count");
+        expect(bridges[0].name == "br0" && bridges[0].stp == true &&
+               bridges[0].ports == std::vector<std::string>{"eth0", "eth1"},
+               "stp and ports");
+        expect(bridges[1].name == "br1" && ! bridges[1].stp &&
+               bridges[1].ports == std::vector<std::string>{"eth2"},
+               "stp left as it is");
+        expect(bridges[2].stp == false && bridges[2].ports.empty(),
+               "stp off");
+        expect(bridges[3].ports.empty(), "no ports");
+        expect(parse("# nothing\n\n   \n").empty(), "empty file");
+
+        refused("bridge br0\nbridge br0\n", "line 2: br0 is given twice");
+        refused("bridge br0 ports eth0\nbridge br1 ports eth0\n",
+                "line 2: eth0 is given twice");
+        refused("bridge br0 ports eth0 eth0\n", "line 1: eth0 is given twice");
+        refused("bridge br0 ports br0\n", "line 1: br0 is given twice");
+        refused("bridge br0 ports eth0\nbridge eth0\n",
+                "line 2: eth0 is given twice");
+        refused("\n# comment\nbrige br0\n",
+                "line 3: expected bridge <name> [stp on|off] "
+                "[ports <dev>...]");
+        refused("bridge\n", "line 1: expected bridge <name> [stp on|off] "
+                            "[ports <dev>...]");
+        refused("bridge br0 stp\n", "line 1: stp takes on or off");
+        refused("bridge br0 stp yes\n", "line 1: stp takes on or off");
+        refused("bridge br0 stp on stp off\n", "line 1: unexpected stp");
+        refused("bridge br0 eth0\n", "line 1: unexpected eth0");
+
+        std::cout << "desired topology: ok" << std::endl;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
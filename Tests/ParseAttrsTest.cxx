@@ -0,0 +1,130 @@
+#include <linux/rtnetlink.h>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "_NetlinkImpl.hxx"
+
+/* Attributes of a message and of a nested attribute go into the tables by
+ * type: unknown types are skipped, missed ones are left as they are and a
+ * truncated attribute is refused. Nothing is sent to the kernel */
+
+/* RTM_NEWLINK message put together byte by byte, so it may be malformed */
+class RawMessage
+{
+public:
+    RawMessage () : _data(NLMSG_SPACE(sizeof(ifinfomsg))) {
+        header().nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg));
+        header().nlmsg_type = RTM_NEWLINK;
+    }
+
+    void put (uint16_t type, std::string_view payload) {
+        const size_t offset = NLMSG_ALIGN(header().nlmsg_len);
+        _data.resize(offset + RTA_SPACE(payload.size()));
+        auto *attr = reinterpret_cast<rtattr *>(_data.data() + offset);
+        attr->rta_type = type;
+        attr->rta_len = RTA_LENGTH(payload.size());
+        std::memcpy(RTA_DATA(attr), payload.data(), payload.size());
+        header().nlmsg_len = offset + RTA_SPACE(payload.size());
+    }
+
+    // Cut the message short, in the middle of its last attribute
+    void truncate (size_t bytes) { header().nlmsg_len -= bytes; }
+
+    nlmsghdr & header () {
+        return *reinterpret_cast<nlmsghdr *>(_data.data());
+    }
+
+private:
+    std::vector<uint8_t> _data;
+};
+
+// Payload of a nested attribute holding the ones given
+static std::string nested (std::initializer_list<std::pair<uint16_t,
+                                                           std::string_view>>
+                           children)
+{
+    std::string payload;
+    for (const auto &[type, data] : children) {
+        std::string attr (RTA_SPACE(data.size()), '\0');
+        auto *rta = reinterpret_cast<rtattr *>(attr.data());
+        rta->rta_type = type;
+        rta->rta_len = RTA_LENGTH(data.size());
+        std::memcpy(RTA_DATA(rta), data.data(), data.size());
+        payload += attr;
+    }
+    return payload;
+}
+
+
+class AttrParser : public _NetlinkImpl
+{
+public:
+    using _NetlinkImpl::parseAttrs;
+    using _NetlinkImpl::parseNestedAttrs;
+    using _NetlinkImpl::readAttr;
+};
+
+static void expect (bool condition, std::string_view what)
+{
+    if (! condition)
+        throw std::runtime_error(std::format("{} failed", what));
+}
+
+int main ()
+{
+    try {
+        const AttrParser parser;
+
+        RawMessage message;
+        message.put(IFLA_IFNAME, std::string_view("br0", 4));
+        message.put(IFLA_MTU, std::string_view("\xdc\x05\0\0", 4));
+        // Beyond a table sized for IFLA_MASTER
+        message.put(IFLA_AF_SPEC | NLA_F_NESTED,
+                    nested({{IFLA_BRIDGE_FLAGS, std::string_view("\1\0", 2)},
+                            {IFLA_BRIDGE_MODE, std::string_view("\0\0", 2)}}));
+
+        const rtattr *tb [IFLA_MAX + 1] = {};
+        parser.parseAttrs(&message.header(), tb);
+        expect(tb[IFLA_IFNAME] &&
+               parser.readAttr<std::string_view>(tb[IFLA_IFNAME]) == "br0",
+               "name");
+        expect(tb[IFLA_MTU] &&
+               parser.readAttr<unsigned int>(tb[IFLA_MTU]) == 1500, "mtu");
+        expect(! tb[IFLA_MASTER], "missed attribute left alone");
+        expect(tb[IFLA_AF_SPEC] != nullptr, "NLA_F_NESTED masked off");
+
+        const rtattr *small [IFLA_MASTER + 1] = {};
+        parser.parseAttrs(&message.header(), small);
+        expect(small[IFLA_IFNAME] && small[IFLA_MTU],
+               "attributes within a small table");
+
+        const rtattr *spec [IFLA_BRIDGE_VLAN_INFO + 1] = {};
+        parser.parseNestedAttrs(tb[IFLA_AF_SPEC], spec);
+        expect(spec[IFLA_BRIDGE_FLAGS] &&
+               parser.readAttr<unsigned short>(spec[IFLA_BRIDGE_FLAGS]) == 1,
+               "nested flags");
+        expect(spec[IFLA_BRIDGE_MODE] != nullptr, "nested mode");
+        expect(! spec[IFLA_BRIDGE_VLAN_INFO], "nested one missed");
+
+        // The last attribute claims more than the message holds
+        message.truncate(2);
+        bool refused = false;
+        try {
+            parser.parseAttrs(&message.header(), tb);
+        } catch (std::runtime_error &e) {
+            refused = std::string_view(e.what()).ends_with(
+                "bytes left after attribute parse");
+        }
+        expect(refused, "truncated message refused");
+
+        std::cout << "attribute tables: ok" << std::endl;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <unistd.h>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Capture.hxx"
+
+/* A conversation is recorded over a scripted transport and played back:
+ * the very same requests get the recorded replies however they're split
+ * into iovecs, anything else makes the replay diverge. Nothing is sent to
+ * the kernel, the capture file is a temporary one */
+
+/* Takes every request and answers with the replies given beforehand */
+class ScriptedTransport : public Transport
+{
+public:
+    static constexpr uint32_t PortId = 4242;
+
+public:
+    // An empty reply stands for an overrun of the receive queue
+    explicit ScriptedTransport (std::vector<std::string> replies) :
+        _replies(std::move(replies)) {}
+
+    virtual void send (std::span<iovec>) override {}
+
+    virtual size_t peek () override {
+        if (_replies.front().empty()) {
+            _replies.erase(_replies.begin());
+            throw Overrun("Netlink receive queue overrun");
+        }
+        return _replies.front().size();
+    }
+
+    virtual std::span<uint8_t> receive (std::span<uint8_t> buffer) override {
+        const std::string reply = std::move(_replies.front());
+        _replies.erase(_replies.begin());
+        std::memcpy(buffer.data(), reply.data(), reply.size());
+        return buffer.first(reply.size());
+    }
+
+    virtual void subscribe (unsigned) override {}
+    virtual uint32_t portId () const override { return PortId; }
+
+private:
+    std::vector<std::string> _replies;
+};
+
+
+static iovec part (std::string_view data)
+{
+    return {.iov_base = const_cast<char *>(data.data()),
+            .iov_len = data.size()};
+}
+
+static std::string receive (Transport &transport)
+{
+    std::vector<uint8_t> buffer (transport.peek());
+    const std::span<uint8_t> data = transport.receive(buffer);
+    return std::string(data.begin(), data.end());
+}
+
+static void expect (bool condition, std::string_view what)
+{
+    if (! condition)
+        throw std::runtime_error(std::format("{} failed", what));
+}
+
+// Check the step fails with the message starting with the text given
+static void expectThrow (std::function<void()> step, std::string_view text,
+                         std::string_view what)
+{
+    try {
+        step();
+    } catch (std::runtime_error &e) {
+        if (std::string_view(e.what()).starts_with(text))
+            return;
+        throw std::runtime_error(std::format("{}: {}", what, e.what()));
+    }
+    throw std::runtime_error(std::format("{} failed", what));
+}
+
+int main ()
+{
+    const std::string path = std::filesystem::temp_directory_path() /
+                             std::format("brctl-replayer-test-{}.nl",
+                                         getpid());
+    // A request of a header and a payload, replies of odd sizes for padding
+    const std::string header = "request-header--";
+    const std::string payload = "payload";
+    const std::string request = header + payload;
+    const std::string first = "reply", second = "the second reply";
+
+    int status = 0;
+    try {
+        {
+            Recorder recorder (std::make_unique<ScriptedTransport>(
+                std::vector<std::string>{first, "", second}), path);
+            iovec parts [] = {part(header), part(payload)};
+            recorder.send(parts);
+            expect(receive(recorder) == first, "first reply recorded");
+            expectThrow([&] { recorder.peek(); }, "Netlink receive queue",
+                        "overrun recorded");
+            expect(receive(recorder) == second, "second reply recorded");
+        }
+
+        {
+            Replayer replayer (path);
+            expect(replayer.portId() == ScriptedTransport::PortId, "portId");
+
+            // The same bytes in one piece
+            iovec whole [] = {part(request)};
+            replayer.send(whole);
+            expect(receive(replayer) == first, "first reply replayed");
+            expectThrow([&] { replayer.peek(); }, "Netlink receive queue",
+                        "overrun replayed");
+            expect(receive(replayer) == second, "second reply replayed");
+            expectThrow([&] { replayer.peek(); }, "Capture file has no more",
+                        "end of the capture");
+        }
+
+        auto sendOnce = [&path](std::string_view sent) {
+            Replayer replayer (path);
+            iovec parts [] = {part(sent)};
+            replayer.send(parts);
+        };
+        std::string changed = request;
+        changed.back() = '!';
+        expectThrow([&] { sendOnce(changed); }, "Replay diverged",
+                    "changed request");
+        expectThrow([&] { sendOnce(header); }, "Replay diverged",
+                    "shorter request");
+        expectThrow([&] { sendOnce(request + "more"); }, "Replay diverged",
+                    "longer request");
+        expectThrow([&] {
+                        Replayer replayer (path);
+                        replayer.peek();
+                    }, "Replay diverged", "reply before the request");
+
+        std::cout << "replayer: ok" << std::endl;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        status = 1;
+    }
+
+    std::filesystem::remove(path);
+    return status;
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "Fdb.hxx"
+
+/* The radix sort must order the entries the way a comparison sort by port,
+ * MAC and VLAN does and keep the order of equal ones, whatever bytes of
+ * the keys the entries share */
+
+static auto key (const FdbEntry &entry)
+{
+    return std::tuple(entry.port,
+                      std::string_view(reinterpret_cast<const char *>(
+                                           entry.mac), sizeof(entry.mac)),
+                      entry.vlan);
+}
+
+static bool same (const std::vector<FdbEntry> &a,
+                  const std::vector<FdbEntry> &b)
+{
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](const FdbEntry &x, const FdbEntry &y) {
+                          return key(x) == key(y) && x.ageing == y.ageing;
+                      });
+}
+
+// Sort both ways, the ageing tells the entries with equal keys apart
+static void check (std::string_view name, std::vector<FdbEntry> entries)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+        entries[i].ageing = i;
+
+    std::vector<FdbEntry> expected = entries;
+    std::ranges::stable_sort(expected, [](const FdbEntry &a,
+                                          const FdbEntry &b) {
+        // MAC bytes compare unsigned as they're sorted
+        auto bytes = [](const FdbEntry &entry) {
+            return std::vector<uint8_t>(entry.mac, entry.mac + 6);
+        };
+        return std::tuple(a.port, bytes(a), a.vlan) <
+               std::tuple(b.port, bytes(b), b.vlan);
+    });
+
+    sortFdb(entries);
+    if (! same(entries, expected))
+        throw std::runtime_error(std::format("{}: wrong order", name));
+    std::cout << std::format("{}: {} entries sorted", name, entries.size())
+              << std::endl;
+}
+
+static FdbEntry entry (int32_t port, uint64_t mac, uint16_t vlan)
+{
+    FdbEntry entry {.port = port, .ageing = 0, .mac = {}, .vlan = vlan,
+                    .state = 0};
+    for (int i = 0; i < 6; ++i)
+        entry.mac[i] = mac >> 8 * (5 - i);
+    return entry;
+}
+
+int main ()
+{
+    try {
+        check("empty", {});
+        check("single", {entry(3, 1, 0)});
+
+        // Every byte the same but one, so the other passes are skipped
+        check("one byte differs", {entry(7, 0x020000000003, 0),
+                                   entry(7, 0x020000000001, 0),
+                                   entry(7, 0x020000000002, 0)});
+
+        // The same keys many times over, their order must stay
+        std::vector<FdbEntry> equal;
+        for (int i = 0; i < 100; ++i)
+            equal.push_back(entry(i % 2 ? 300 : 5, 0xaabbccddeeff, 10));
+        check("equal keys", equal);
+
+        // ifindexes and VLANs above a byte, MACs with the high bit set.
+        // Few values of each, so equal keys are common
+        std::mt19937 random (42);
+        auto any = [&random](uint64_t max) {
+            return std::uniform_int_distribution<uint64_t>(0, max)(random);
+        };
+        std::vector<FdbEntry> mixed;
+        for (int i = 0; i < 10000; ++i)
+            mixed.push_back(entry(i % 3 ? any(7) + 1 : any(70000) + 1,
+                                  any(0xffffffffffff) & 0xff00000300ff,
+                                  i % 5 ? any(4094) & 0x10f : 0));
+        check("mixed", mixed);
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
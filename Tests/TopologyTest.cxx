@@ -0,0 +1,102 @@
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "Topology.hxx"
+
+/* Links come in any order of ifindexes, get renamed, move between bridges
+ * and go away, and the ports of every bridge must follow. Names are string
+ * literals, so they outlive the topology as the arena would */
+
+static Link makeLink (int index, std::string_view name, uint32_t master = 0,
+                      bool bridge = false)
+{
+    Link link;
+    link.index = index;
+    link.name = name;
+    link.master = master;
+    link.bridge = bridge;
+    return link;
+}
+
+static void expect (bool condition, std::string_view what)
+{
+    if (! condition)
+        throw std::runtime_error(std::format("{} failed", what));
+}
+
+static bool same (std::span<const int> indexes, std::vector<int> expected)
+{
+    return std::vector<int>(indexes.begin(), indexes.end()) == expected;
+}
+
+int main ()
+{
+    try {
+        Topology topology;
+
+        // Ports before their bridges and above them
+        topology.insert(makeLink(42, "eth2", 7));
+        topology.insert(makeLink(3, "eth0", 7));
+        topology.insert(makeLink(9, "eth1", 5));
+        topology.insert(makeLink(7, "br1", 0, true));
+        topology.insert(makeLink(5, "br0", 0, true));
+        topology.insert(makeLink(12, "eth3", 7));
+
+        expect(topology.size() == 6, "size");
+        expect(same(topology.ports(7), {3, 12, 42}), "ports ascending");
+        expect(same(topology.ports(5), {9}), "single port");
+        expect(topology.ports(3).empty(), "no ports of a port");
+        expect(topology.ports(100).empty(), "no ports of an unknown link");
+        expect(topology.bridges() == std::vector<int>({5, 7}),
+               "bridges by name");
+
+        // A port moves, another bridge comes with a lower ifindex
+        topology.setMaster(42, 5);
+        topology.insert(makeLink(2, "br2", 0, true));
+        topology.setMaster(3, 2);
+        expect(same(topology.ports(7), {12}), "ports after the moves");
+        expect(same(topology.ports(5), {9, 42}), "port moved in");
+        expect(same(topology.ports(2), {3}), "port of a new bridge");
+        expect(topology.bridges() == std::vector<int>({5, 7, 2}),
+               "new bridge among the others by name");
+
+        // Renamed in place, then the old name taken by a new ifindex
+        topology.insert(makeLink(12, "wan0", 7));
+        expect(! topology.find("eth3"), "old name forgotten");
+        expect(topology.find("wan0") && topology.find("wan0")->index == 12,
+               "new name found");
+        topology.insert(makeLink(50, "wan0", 7));
+        expect(! topology.find(12), "name moved to another ifindex");
+        expect(same(topology.ports(7), {50}), "ports after the name moved");
+
+        // The ports of a bridge gone have a master nobody knows
+        topology.erase(7);
+        expect(! topology.find("br1") && ! topology.find(7), "bridge erased");
+        expect(topology.ports(7).empty(), "no ports of an erased bridge");
+        expect(topology.find(50)->master == 7, "port left as it is");
+        topology.erase(7);
+        topology.setMaster(7, 5);
+        expect(topology.size() == 6, "erase and setMaster of nothing");
+
+        bool refused = false;
+        try {
+            topology.insert(makeLink(0, "nothing"));
+        } catch (std::runtime_error &) {
+            refused = true;
+        }
+        expect(refused, "ifindex 0 refused");
+
+        topology.clear();
+        expect(! topology.size() && topology.bridges().empty() &&
+               topology.ports(5).empty(), "clear");
+
+        std::cout << "topology: ok" << std::endl;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
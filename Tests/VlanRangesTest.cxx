@@ -0,0 +1,77 @@
+#include <linux/if_bridge.h>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Vlan.hxx"
+
+/* Lists of VLAN ids come out sorted with the overlapping and adjacent
+ * ranges merged, and anything but ids 1-4094 is refused */
+
+static std::string format (const std::vector<VlanRange> &ranges)
+{
+    std::string text;
+    for (const VlanRange &range : ranges) {
+        text += text.empty() ? "" : ",";
+        text += range.first == range.last
+                    ? std::format("{}", range.first)
+                    : std::format("{}-{}", range.first, range.last);
+    }
+    return text;
+}
+
+static void parses (std::string_view text, std::string_view expected)
+{
+    const std::vector<VlanRange> ranges = parseVlanRanges(text);
+    if (format(ranges) != expected)
+        throw std::runtime_error(std::format("\"{}\" parsed as \"{}\", "
+                                             "expected \"{}\"", text,
+                                             format(ranges), expected));
+}
+
+static void refused (std::string_view text)
+{
+    try {
+        parseVlanRanges(text);
+    } catch (std::invalid_argument &) {
+        return;
+    }
+    throw std::runtime_error(std::format("\"{}\" isn't refused", text));
+}
+
+int main ()
+{
+    try {
+        parses("1", "1");
+        parses("1-4094", "1-4094");
+        parses("200,1-100", "1-100,200");
+        // Overlapping, nested, adjacent and repeated ones
+        parses("10-20,15-30", "10-30");
+        parses("1-100,20-30", "1-100");
+        parses("5,6,7,9", "5-7,9");
+        parses("100-200,201", "100-201");
+        parses("7,7,7", "7");
+        parses("300-400,1-10,11-299", "1-400");
+
+        const std::vector<VlanRange> flagged =
+            parseVlanRanges("30,10", BRIDGE_VLAN_INFO_PVID);
+        if (flagged.size() != 2 ||
+            flagged[0].flags != BRIDGE_VLAN_INFO_PVID ||
+            flagged[1].flags != BRIDGE_VLAN_INFO_PVID)
+            throw std::runtime_error("flags aren't given to every range");
+
+        for (std::string_view text : {"", "0", "4095", "1-4095", "20-10",
+                                      "1,,2", "1,", ",1", "-5", "5-", "a",
+                                      "1-2-3", "+5", " 5", "5 ", "0x10"})
+            refused(text);
+
+        std::cout << "vlan ranges: ok" << std::endl;
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}